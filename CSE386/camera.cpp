@@ -103,6 +103,21 @@ dvec2 RaytracingCamera::getProjectionPlaneCoordinates(double x, double y) const
 	return s;
 }
 
+/**
+ * @fn	dvec2 RaytracingCamera::getWindowCoordinates(const dvec2& planePt) const
+ * @brief	Inverse of getProjectionPlaneCoordinates. Maps a point on the projection
+ *			plane back to (continuous) window coordinates.
+ * @param	planePt	The point on the projection plane, in (u, v) coordinates.
+ * @return	Window coordinates. The pixel containing the point is (floor(x), floor(y)).
+ */
+
+dvec2 RaytracingCamera::getWindowCoordinates(const dvec2& planePt) const {
+	dvec2 w;
+	w.x = map(planePt.x, left, right, 0, nx) - 0.5;
+	w.y = map(planePt.y, bottom, top, 0, ny) - 0.5;
+	return w;
+}
+
 /**
  * @fn	void PerspectiveCamera::setupViewingParameters(int W, int H)
  * @brief	Calculates the viewing parameters associated with this camera.
@@ -178,6 +193,37 @@ Ray PerspectiveCamera::getRay(double x, double y) const {
 	return Ray(cameraFrame.origin, rayDirection);
 }
 
+/**
+ * @fn	bool OrthographicCamera::projectToWindow(const dvec3& worldPt, dvec2& windowPt) const
+ * @brief	Determines where a world point appears in the window. Inverse of getRay.
+ * @param	worldPt		The point, in world coordinates.
+ * @param	windowPt	[out] The corresponding window coordinates.
+ * @return	False if the point lies behind the projection plane.
+ */
+
+bool OrthographicCamera::projectToWindow(const dvec3& worldPt, dvec2& windowPt) const {
+	dvec3 P = cameraFrame.globalCoordToFrameCoords(worldPt);
+	windowPt = getWindowCoordinates(P.xy());
+	return P.z < 0.0;
+}
+
+/**
+ * @fn	bool PerspectiveCamera::projectToWindow(const dvec3& worldPt, dvec2& windowPt) const
+ * @brief	Determines where a world point appears in the window. Inverse of getRay.
+ * @param	worldPt		The point, in world coordinates.
+ * @param	windowPt	[out] The corresponding window coordinates.
+ * @return	False if the point lies behind the camera.
+ */
+
+bool PerspectiveCamera::projectToWindow(const dvec3& worldPt, dvec2& windowPt) const {
+	dvec3 P = cameraFrame.globalCoordToFrameCoords(worldPt);
+	if (P.z >= 0.0) {
+		return false;
+	}
+	windowPt = getWindowCoordinates(distToPlane * P.xy() / -P.z);
+	return true;
+}
+
 /**
 * @fn	ostream &operator << (ostream &os, const RaytracingCamera &camera)
 * @brief	Output stream for cameras.
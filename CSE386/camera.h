@@ -20,6 +20,7 @@ struct RaytracingCamera {
 	RaytracingCamera(const dvec3& pos, const dvec3& lookAtPt, const dvec3& up,
 		int width, int height);
 	virtual Ray getRay(double x, double y) const = 0;
+	virtual bool projectToWindow(const dvec3& worldPt, dvec2& windowPt) const = 0;
 	Frame getFrame() const { return cameraFrame; }
 	int getNX() const { return nx; }
 	int getNY() const { return ny; }
@@ -35,6 +36,7 @@ protected:
 	void setupFrame(const dvec3& pos, const dvec3& lookAtPt, const dvec3& up);
 	virtual void setupViewingParameters(int width, int height) = 0;
 	dvec2 getProjectionPlaneCoordinates(double x, double y) const;
+	dvec2 getWindowCoordinates(const dvec2& planePt) const;
 public:
 
 	friend ostream& operator << (ostream& os, const RaytracingCamera& camera);
@@ -49,6 +51,7 @@ struct PerspectiveCamera : public RaytracingCamera {
 	PerspectiveCamera(const dvec3& pos, const dvec3& lookAtPt, const dvec3& up, double FOVRads,
 		int width, int height);
 	virtual Ray getRay(double x, double y) const;
+	virtual bool projectToWindow(const dvec3& worldPt, dvec2& windowPt) const;
 	double getDistToPlane() const { return distToPlane; }
 private:
 	double fov;						//!< The camera's field of view
@@ -65,6 +68,7 @@ struct OrthographicCamera : public RaytracingCamera {
 	OrthographicCamera(const dvec3& pos, const dvec3& lookAtPt, const dvec3& up,
 		int width, int height, double scaleFactor = 1.0);
 	virtual Ray getRay(double x, double y) const;
+	virtual bool projectToWindow(const dvec3& worldPt, dvec2& windowPt) const;
 private:
 	double scale;		//!< Controls the size of the image plane.
 	virtual void setupViewingParameters(int width, int height);
@@ -7,9 +7,14 @@
  * permission is granted.
  ****************************************************/
 
+#include <cassert>
+#include <cstdlib>
 #include "utilities.h"
 #include "colorandmaterials.h"
 
+const uint16_t MaterialPalette::BLENDED;
+const uint16_t MaterialPalette::NONE;
+
  /**
   * @fn	Material::Material(const color &amb, const color &diff, const color &spec, double S)
   * @brief	Construct a Materials based on the basic color and shinieness values.
@@ -110,4 +115,54 @@ Material Material::operator +(const Material& mat) const {
 
 Material operator *(double w, const Material& mat) {
 	return mat * w;
-}
\ No newline at end of file
+}
+
+/**
+ * @fn	bool Material::operator==(const Material &mat) const
+ * @brief	Equality operator.
+ * @param	mat	The second Material.
+ * @return	True if every property is the same.
+ */
+
+bool Material::operator ==(const Material& mat) const {
+	return ambient == mat.ambient && diffuse == mat.diffuse &&
+		specular == mat.specular && shininess == mat.shininess;
+}
+
+/**
+ * @fn	std::deque<Material> &MaterialPalette::table()
+ * @brief	The palette's materials. A function-local static, so that shapes built
+ *			during static initialization can already register materials.
+ * @return	The table.
+ */
+
+std::deque<Material>& MaterialPalette::table() {
+	static std::deque<Material> materials;
+	return materials;
+}
+
+/**
+ * @fn	uint16_t MaterialPalette::idOf(const Material &mat)
+ * @brief	Finds the id of a material, adding it to the palette if it is new.
+ *			Scenes use a handful of materials, so a linear search is fine. Running
+ *			out of ids is a fatal error, since reusing one would silently give
+ *			objects another material's colors.
+ * @param	mat	The material.
+ * @return	The material's id.
+ */
+
+uint16_t MaterialPalette::idOf(const Material& mat) {
+	std::deque<Material>& materials = table();
+	for (size_t i = 0; i < materials.size(); i++) {
+		if (materials[i] == mat) {
+			return (uint16_t)i;
+		}
+	}
+	if (materials.size() >= NONE) {
+		cout << "Error: Too many materials in palette" << endl;
+		assert(materials.size() < NONE);
+		exit(EXIT_FAILURE);
+	}
+	materials.push_back(mat);
+	return (uint16_t)(materials.size() - 1);
+}
@@ -9,6 +9,7 @@
 
 #pragma once
 #include <vector>
+#include <deque>
 #include "defs.h"
 
 typedef dvec3 color;
@@ -46,6 +47,28 @@ struct Material {
 	Material operator *(double w) const;
 	Material& operator +=(const Material& mat);
 	Material operator +(const Material& mat) const;
+	bool operator ==(const Material& mat) const;
+};
+
+/**
+ * @struct	MaterialPalette
+ * @brief	Global table of materials, so that vertices and fragments can refer to a
+ *			material by a 16-bit id rather than carrying all of its values. A material
+ *			gets an id the first time it is seen. The materials are kept in a deque,
+ *			so references returned by get stay valid when materials are added.
+ *			Adding materials is not thread-safe, though: it must not happen while
+ *			the pipeline is running (see DrawState).
+ */
+
+struct MaterialPalette {
+	static const uint16_t BLENDED = 0xFFFF;	//!< Id of a fragment whose material was interpolated
+	static const uint16_t NONE = 0xFFFE;	//!< Id of no material, e.g., an empty G-buffer pixel
+
+	static uint16_t idOf(const Material& mat);
+	static const Material& get(uint16_t id) { return table()[id]; }
+	static size_t size() { return table().size(); }
+protected:
+	static std::deque<Material>& table();
 };
 
 // http://www.it.hiof.no/~borres/j3d/explain/light/p-materials.html
@@ -19,6 +19,20 @@
 #include <algorithm>
 
 //#define QUARTER_DISPLAY
+//#define FLOAT_PIXEL_BUFFERS	// store depth and G-buffer values as floats
+
+// On x86, AVX2 versions of the inner loops are compiled alongside the scalar ones
+// and picked at run time (see cpuHasAVX2), so every build runs on any x86 CPU.
+// Functions using AVX2 intrinsics are marked AVX2_TARGET.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define AVX2_PATHS
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
 
 #ifndef CONSOLE_ONLY
 #include <GLFW/glfw3.h>
@@ -47,6 +61,20 @@ using glm::dmat2;
 using glm::dmat3;
 using glm::dmat4;
 
+// Precision of the large per-pixel buffers (depth, G-buffer normals and positions).
+// Defining FLOAT_PIXEL_BUFFERS stores them in float, halving their memory and
+// bandwidth. Vertices, rays, colors and all arithmetic stay double.
+#ifdef FLOAT_PIXEL_BUFFERS
+typedef float PixelReal;				//!< Precision of large per-pixel buffers
+const string PIXEL_REAL_NAME = "float";
+#else
+typedef double PixelReal;				//!< Precision of large per-pixel buffers
+const string PIXEL_REAL_NAME = "double";
+#endif
+typedef glm::vec<2, PixelReal> pvec2;
+typedef glm::vec<3, PixelReal> pvec3;
+typedef glm::vec<4, PixelReal> pvec4;
+
 const std::string username = "coppestj"; 
 const double EPSILON = 1.0E-3;		//!< default value used for "SMALL" tolerances.
 
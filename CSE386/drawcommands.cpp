@@ -0,0 +1,84 @@
+/****************************************************
+ * 2016-2025 Eric Bachmann and Mike Zmuda
+ * All Rights Reserved.
+ * NOTICE:
+ * Dissemination of this information or reproduction
+ * of this material is prohibited unless prior written
+ * permission is granted.
+ ****************************************************/
+
+#include "drawcommands.h"
+
+const int DrawState::KEEP_MATERIAL;
+
+/**
+ * @fn	void DrawCommandBuffer::draw(const EShapeData &shape, const dmat4 &modelingMatrix,
+ *									const DrawState &state)
+ * @brief	Records a draw of a shape.
+ * @param	shape		  	The shape. It must outlive the submit.
+ * @param	modelingMatrix	The transformation applied to the shape.
+ * @param	state		  	Backfaces, opacity and material.
+ */
+
+void DrawCommandBuffer::draw(const EShapeData& shape, const dmat4& modelingMatrix,
+	const DrawState& state) {
+	commands.push_back(DrawCommand{ &shape, nullptr, modelingMatrix, state, 0.0 });
+}
+
+/**
+ * @fn	void DrawCommandBuffer::draw(const IndexedMesh &mesh, const dmat4 &modelingMatrix,
+ *									const DrawState &state)
+ * @brief	Records a draw of an indexed mesh.
+ * @param	mesh		  	The mesh. It must outlive the submit.
+ * @param	modelingMatrix	The transformation applied to the mesh.
+ * @param	state		  	Backfaces, opacity and material.
+ */
+
+void DrawCommandBuffer::draw(const IndexedMesh& mesh, const dmat4& modelingMatrix,
+	const DrawState& state) {
+	commands.push_back(DrawCommand{ nullptr, &mesh, modelingMatrix, state, 0.0 });
+}
+
+/**
+ * @fn	void DrawCommandBuffer::submit(FrameBuffer &frameBuffer,
+ *										const vector<LightSourcePtr> &lights,
+ *										const PipelineMatrices &pipeMats)
+ * @brief	Renders the recorded draws. Draws whose bounding sphere is out of view are
+ *			dropped. If sortingOn, opaque draws go first, nearest first; the others
+ *			follow, farthest first. Draws without a known bound count as farthest
+ *			away, and draws at equal depth keep the order in which they were
+ *			recorded. Otherwise all the draws keep their recorded order.
+ * @param [in,out]	frameBuffer	Buffer for frame data.
+ * @param 		  	lights	   	The lights.
+ * @param 		  	pipeMats   	The pipeline matrices.
+ */
+
+void DrawCommandBuffer::submit(FrameBuffer& frameBuffer, const vector<LightSourcePtr>& lights,
+	const PipelineMatrices& pipeMats) {
+	visible.clear();
+	for (const DrawCommand& cmd : commands) {
+		const BoundingSphere& bounds = cmd.bounds();
+		if (VertexOps::isOutsideFrustum(bounds, cmd.modelingMatrix, pipeMats)) {
+			continue;
+		}
+		visible.push_back(cmd);
+		DrawCommand& added = visible.back();
+		if (bounds.radius < 0.0) {
+			added.depth = std::numeric_limits<double>::max();
+		} else {
+			dvec4 center = pipeMats.viewingMatrix * cmd.modelingMatrix * dvec4(bounds.center, 1.0);
+			added.depth = -center.z;
+		}
+	}
+
+	if (sortingOn) {
+		std::stable_sort(visible.begin(), visible.end(),
+			[](const DrawCommand& a, const DrawCommand& b) {
+				if (a.state.opaque != b.state.opaque) {
+					return a.state.opaque;
+				}
+				return a.state.opaque ? a.depth < b.depth : a.depth > b.depth;
+			});
+	}
+	VertexOps::render(frameBuffer, visible, lights, pipeMats);
+}
@@ -0,0 +1,82 @@
+/****************************************************
+ * 2016-2025 Eric Bachmann and Mike Zmuda
+ * All Rights Reserved.
+ * NOTICE:
+ * Dissemination of this information or reproduction
+ * of this material is prohibited unless prior written
+ * permission is granted.
+ ****************************************************/
+
+#pragma once
+
+#include "defs.h"
+#include "eshape.h"
+#include "vertexops.h"
+
+/**
+ * @struct	DrawState
+ * @brief	The per-draw state recorded with a DrawCommand. Constructing one from a
+ *			Material registers the material with the MaterialPalette, which is not
+ *			thread-safe, so draws must not be recorded while a submit is running.
+ */
+
+struct DrawState {
+	static const int KEEP_MATERIAL = -1;	//!< materialID value that keeps the vertices' materials
+
+	bool renderBackfaces;	//!< True ==> backfaces are drawn
+	bool opaque;			//!< False ==> drawn after the opaque draws, back to front
+	int materialID;			//!< MaterialPalette id replacing the vertices' materials, or KEEP_MATERIAL
+
+	DrawState(bool renderBackfaces = true)
+		: renderBackfaces(renderBackfaces), opaque(true), materialID(KEEP_MATERIAL) {
+	}
+	DrawState(const Material& mat, bool renderBackfaces = true)
+		: renderBackfaces(renderBackfaces), opaque(true),
+		materialID(MaterialPalette::idOf(mat)) {
+	}
+};
+
+/**
+ * @struct	DrawCommand
+ * @brief	One recorded draw: exactly one of shape and mesh is non-null. The
+ *			geometry is referred to, not copied, so it must outlive the submit.
+ */
+
+struct DrawCommand {
+	const EShapeData* shape;	//!< Unindexed triangles, or nullptr
+	const IndexedMesh* mesh;	//!< Indexed triangles, or nullptr
+	dmat4 modelingMatrix;		//!< The transformation applied to the object
+	DrawState state;			//!< Backfaces, opacity and material
+	double depth;				//!< Distance of the bounding sphere's center from the eye; set by submit
+
+	const BoundingSphere& bounds() const { return shape != nullptr ? shape->bounds : mesh->bounds; }
+};
+
+/**
+ * @struct	DrawCommandBuffer
+ * @brief	Records draws so that a whole frame's worth can be rendered at once.
+ *			submit culls the draws against the view frustum, sorts the opaque ones
+ *			front to back (so that the depth test rejects as many fragments as
+ *			possible) and the rest back to front, then hands them all to
+ *			VertexOps::render, which processes them in parallel batches. With
+ *			sortingOn false, the draws keep the order in which they were recorded.
+ *			Recorded draws are kept until clear is called, so a static scene can be
+ *			recorded once and submitted every frame.
+ */
+
+struct DrawCommandBuffer {
+	bool sortingOn;		//!< True ==> submit sorts the draws by depth
+
+	DrawCommandBuffer(bool sortingOn = true) : sortingOn(sortingOn) {}
+	void draw(const EShapeData& shape, const dmat4& modelingMatrix,
+		const DrawState& state = DrawState());
+	void draw(const IndexedMesh& mesh, const dmat4& modelingMatrix,
+		const DrawState& state = DrawState());
+	void submit(FrameBuffer& frameBuffer, const vector<LightSourcePtr>& lights,
+		const PipelineMatrices& pipeMats);
+	void clear() { commands.clear(); }
+	size_t size() const { return commands.size(); }
+protected:
+	vector<DrawCommand> commands;	//!< The draws, in the order they were recorded
+	vector<DrawCommand> visible;	//!< The draws that survived culling, in drawing order
+};
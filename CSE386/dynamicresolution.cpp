@@ -0,0 +1,81 @@
+/****************************************************
+ * 2016-2025 Eric Bachmann and Mike Zmuda
+ * All Rights Reserved.
+ * NOTICE:
+ * Dissemination of this information or reproduction
+ * of this material is prohibited unless prior written
+ * permission is granted.
+ ****************************************************/
+
+#include "dynamicresolution.h"
+
+/**
+ * @fn	DynamicResolution::DynamicResolution(double targetMs, double minScale, double holdMs)
+ * @brief	Constructor. Starts at native resolution.
+ * @param	targetMs	Desired time per frame while interacting (e.g., 33 for 30 fps).
+ * @param	minScale	Smallest fraction of the native size to render at.
+ * @param	holdMs  	How long after the latest input the user counts as interacting.
+ */
+
+DynamicResolution::DynamicResolution(double targetMs, double minScale, double holdMs)
+	: isOn(true), targetMs(targetMs), minScale(minScale), holdMs(holdMs),
+	scale(1.0), lastFrameMs(0.0), interacting(false) {
+}
+
+/**
+ * @fn	void DynamicResolution::inputReceived()
+ * @brief	Records user input. If this starts an interaction and the latest frame was
+ *			too slow, the scale drops right away, so the first frame rendered after
+ *			the input is already at reduced resolution.
+ */
+
+void DynamicResolution::inputReceived() {
+	if (isOn && !interacting && lastFrameMs > targetMs) {
+		scale = glm::clamp(scale * std::sqrt(targetMs / lastFrameMs), minScale, 1.0);
+	}
+	interacting = true;
+	lastInput = Clock::now();
+}
+
+/**
+ * @fn	void DynamicResolution::frameFinished(double frameMs)
+ * @brief	Chooses the scale of the next frame. Render time is roughly proportional
+ *			to the number of pixels, i.e., to scale squared, so the scale is multiplied
+ *			by the square root of target / measured. The change per frame is limited
+ *			so a single slow or fast frame does not make the resolution jump around.
+ *			Once holdMs have passed since the latest input, the scale climbs back.
+ * @param	frameMs	How long the frame that was just displayed took.
+ */
+
+void DynamicResolution::frameFinished(double frameMs) {
+	lastFrameMs = frameMs;
+	if (!isOn) {
+		scale = 1.0;
+		return;
+	}
+	if (interacting &&
+		std::chrono::duration<double, std::milli>(Clock::now() - lastInput).count() > holdMs) {
+		interacting = false;
+	}
+	if (interacting) {
+		const double MAX_CHANGE = 1.25;
+		double ratio = std::sqrt(targetMs / std::max(frameMs, 1.0));
+		ratio = glm::clamp(ratio, 1.0 / MAX_CHANGE, MAX_CHANGE);
+		if (std::abs(ratio - 1.0) > 0.05) {	// ignore small fluctuations
+			scale = glm::clamp(scale * ratio, minScale, 1.0);
+		}
+	} else {
+		scale = std::min(scale * 2.0, 1.0);
+	}
+}
+
+/**
+ * @fn	int DynamicResolution::scaled(int nativeSize) const
+ * @brief	Scales a native window dimension.
+ * @param	nativeSize	The width or height of the window.
+ * @return	The width or height to render at.
+ */
+
+int DynamicResolution::scaled(int nativeSize) const {
+	return std::max(1, (int)std::round(nativeSize * scale));
+}
@@ -0,0 +1,41 @@
+/****************************************************
+ * 2016-2025 Eric Bachmann and Mike Zmuda
+ * All Rights Reserved.
+ * NOTICE:
+ * Dissemination of this information or reproduction
+ * of this material is prohibited unless prior written
+ * permission is granted.
+ ****************************************************/
+
+#pragma once
+
+#include <chrono>
+#include "defs.h"
+
+/**
+ * @struct	DynamicResolution
+ * @brief	Picks the resolution to render at so that interactive frames take about
+ *			targetMs milliseconds. The user counts as interacting until holdMs
+ *			milliseconds after the latest input. While interacting, the render scale
+ *			follows the measured frame times; once the hold expires, it climbs back
+ *			to 1 (native resolution) regardless of frame time.
+ */
+
+struct DynamicResolution {
+	DynamicResolution(double targetMs, double minScale = 0.25, double holdMs = 300.0);
+	void inputReceived();
+	void frameFinished(double frameMs);
+	double getScale() const { return scale; }
+	int scaled(int nativeSize) const;
+	bool isOn;				//!< When false, getScale is always 1
+protected:
+	typedef std::chrono::steady_clock Clock;
+
+	double targetMs;		//!< Desired time per frame while interacting
+	double minScale;		//!< Smallest allowed scale
+	double holdMs;			//!< How long after the latest input the user counts as interacting
+	double scale;			//!< Fraction of the native width and height to render
+	double lastFrameMs;		//!< How long the latest frame took
+	bool interacting;		//!< True until holdMs after the latest input
+	Clock::time_point lastInput;	//!< When the latest input arrived
+};
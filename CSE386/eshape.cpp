@@ -7,9 +7,84 @@
  * permission is granted.
  ****************************************************/
 
-#include <fstream>
-#include <sstream>
+#include <map>
+#include <array>
 #include "eshape.h"
+#include "objloader.h"
+
+/**
+ * @fn	BoundingSphere BoundingSphere::enclosing(const vector<VertexData> &vertices)
+ * @brief	Finds a sphere enclosing a set of vertices. The sphere is centered on
+ *			the vertices' axis-aligned bounding box, which is close to the smallest
+ *			sphere for most shapes and takes only two passes.
+ * @param	vertices	The vertices.
+ * @return	The sphere; unknown (negative radius) if there are no vertices.
+ */
+
+BoundingSphere BoundingSphere::enclosing(const vector<VertexData>& vertices) {
+	BoundingSphere result;
+	if (vertices.empty()) {
+		return result;
+	}
+	dvec3 lo = vertices[0].pos.xyz();
+	dvec3 hi = lo;
+	for (const VertexData& v : vertices) {
+		lo = glm::min(lo, v.pos.xyz());
+		hi = glm::max(hi, v.pos.xyz());
+	}
+	result.center = (lo + hi) / 2.0;
+	double radius2 = 0.0;
+	for (const VertexData& v : vertices) {
+		dvec3 d = v.pos.xyz() - result.center;
+		radius2 = std::max(radius2, glm::dot(d, d));
+	}
+	result.radius = std::sqrt(radius2);
+	return result;
+}
+
+/**
+ * @fn	IndexedMesh::IndexedMesh(const EShapeData &triangles)
+ * @brief	Builds an indexed mesh from a list of triangles, merging vertices that
+ *			are identical in every attribute. Vertices of neighboring flat-shaded
+ *			triangles only merge where their normals agree.
+ * @param	triangles	The triangles; each triplet of vertices is one triangle.
+ */
+
+IndexedMesh::IndexedMesh(const EShapeData& triangles) {
+	typedef std::array<double, 10> Key;
+	std::map<Key, uint32_t> seen;
+
+	indices.reserve(triangles.size());
+	for (const VertexData& v : triangles) {
+		Key key = { v.pos.x, v.pos.y, v.pos.z, v.pos.w,
+					v.normal.x, v.normal.y, v.normal.z,
+					v.texCoord.x, v.texCoord.y, (double)v.materialID };
+		auto found = seen.find(key);
+		if (found == seen.end()) {
+			found = seen.insert(std::make_pair(key, (uint32_t)vertices.size())).first;
+			vertices.push_back(v);
+		}
+		indices.push_back(found->second);
+	}
+	bounds = BoundingSphere::enclosing(vertices);
+}
+
+/**
+ * @fn	EShapeData IndexedMesh::toTriangles() const
+ * @brief	Expands the mesh back into a list of triangles.
+ * @return	The triangles; each triplet of vertices is one triangle.
+ */
+
+EShapeData IndexedMesh::toTriangles() const {
+	EShapeData result;
+	result.reserve(indices.size());
+	for (uint32_t i : indices) {
+		result.push_back(vertices[i]);
+	}
+	result.computeBounds();
+	return result;
+}
+
  /**
   * @fn	EShapeData EShape::createEDisk(const Material &mat, int slices)
   * @brief	Creates a disk with radius 1, centered on origin and lying at z = 0
@@ -32,6 +107,7 @@ EShapeData EShape::createEDisk(const Material& mat, int slices) {
 		VertexData::addTriVertsAndComputeNormal(result, A, B, C, mat);
 	}
 
+	result.computeBounds();
 	return result;
 }
 
@@ -61,6 +137,7 @@ EShapeData EShape::createECylinder(const Material& mat, int slices) {
 		VertexData::addTriVertsAndComputeNormal(result, C, B, D, mat);
 	}
 
+	result.computeBounds();
 	return result;
 }
 
@@ -86,6 +163,7 @@ EShapeData EShape::createECone(const Material& mat, int slices) {
 		VertexData::addTriVertsAndComputeNormal(result, tip, C, B, mat);
 	}
 
+	result.computeBounds();
 	return result;
 }
 
@@ -104,6 +182,7 @@ EShapeData EShape::createETriangle(const Material& mat,
 	const dvec4& A, const dvec4& B, const dvec4& C) {
 	EShapeData result;
 	VertexData::addTriVertsAndComputeNormal(result, A, B, C, mat);
+	result.computeBounds();
 	return result;
 }
 
@@ -142,64 +221,112 @@ EShapeData EShape::createECheckerBoard(const Material& mat1, const Material& mat
 			isMat1 = !isMat1;
 		}
 	}
+	result.computeBounds();
 	return result;
 }
 
-// This code provided by Jack Duval
+/**
+ * @fn	EShapeData EShape::createEObj(const string &filename)
+ * @brief	Loads the triangles of an OBJ file. Each triangle is flat shaded; texture
+ *			coordinates are kept where the file has them.
+ * @param	filename	The OBJ file.
+ * @return	The triangles.
+ */
+
 EShapeData EShape::createEObj(const string& filename) {
 	EShapeData result;
-	std::ifstream in(filename);
-	if (!in.is_open()) {
-		cout << "Error: Cannot open file " << filename << endl;
+	ObjData obj;
+	if (!obj.read(filename)) {
 		return result;
 	}
 
-	// Loads all the vertices into a vector and faces into a vector
-	vector<dvec4> vertices;
-	vector<glm::ivec3> faces;
-	std::string line;
-	int faceCount = 0;
-	while (std::getline(in, line)) {
-		if (line.substr(0, 2) == "v ") {
-			std::istringstream s(line.substr(2));
-			double x, y, z;
-			s >> x >> y >> z;
-			vertices.push_back(dvec4(x, y, z, 1.0));
-		} else if (line.substr(0, 2) == "f ") {
-			// Splits the line into a vector of strings
-			std::istringstream s(line.substr(2));
-			std::vector<std::string> face;
-			std::string temp;
-			while (s >> temp) {
-				face.push_back(temp);
+	const uint16_t MAT = MaterialPalette::idOf(redPlastic);
+	result.reserve(obj.corners.size());
+	for (size_t i = 0; i < obj.corners.size(); i += 3) {
+		const ObjCorner* corner = &obj.corners[i];
+		const dvec3& A = obj.positions[corner[0].position];
+		const dvec3& B = obj.positions[corner[1].position];
+		const dvec3& C = obj.positions[corner[2].position];
+		dvec3 n = normalFrom3Points(A, B, C);
+		for (int j = 0; j < 3; j++) {
+			result.push_back(VertexData(dvec4(obj.positions[corner[j].position], 1.0), n, MAT, ORIGIN3D));
+			if (corner[j].texCoord != ObjCorner::NONE) {
+				result.back().texCoord = obj.texCoords[corner[j].texCoord];
 			}
+		}
+	}
+
+	result.computeBounds();
+	return result;
+}
 
-			// Faces are read as f v1/vt1/vn1 v2/vt2/vn2 v3/vt3/vn3. 
-			// We need to convert them to f v1 v2 v3
-			for (int i = 0; i < face.size(); i++) {
-				std::istringstream s(face[i]);
-				int v;
-				s >> v;
-				if (i == 0) {
-					faces.push_back(glm::ivec3(v, 0, 0));
-				} else if (i == 1) {
-					faces.at(faceCount) = glm::ivec3(faces.at(faceCount).x, v, 0);
-				} else if (i == 2) {
-					faces.at(faceCount) = glm::ivec3(faces.at(faceCount).x, faces.at(faceCount).y, v);
-				}
+/**
+ * @fn	IndexedMesh EShape::createEObjIndexed(const string &filename)
+ * @brief	Loads an OBJ file as an indexed mesh, keeping the file's vertex sharing.
+ *			A mesh vertex is made for each distinct combination of position, texture
+ *			coordinate and normal used by the faces. Where the file gives no normal,
+ *			the vertex gets the area-weighted average of the normals of the faces
+ *			around its position, which makes the surface smooth shaded.
+ * @param	filename	The OBJ file.
+ * @return	The mesh.
+ */
+
+IndexedMesh EShape::createEObjIndexed(const string& filename) {
+	IndexedMesh result;
+	ObjData obj;
+	if (!obj.read(filename)) {
+		return result;
+	}
+
+	bool needsNormals = false;
+	for (const ObjCorner& corner : obj.corners) {
+		needsNormals = needsNormals || corner.normal == ObjCorner::NONE;
+	}
+	vector<dvec3> smoothNormals;
+	if (needsNormals) {
+		smoothNormals.assign(obj.positions.size(), dvec3(0.0, 0.0, 0.0));
+		for (size_t i = 0; i < obj.corners.size(); i += 3) {
+			const int32_t I[3] = { obj.corners[i].position, obj.corners[i + 1].position,
+									obj.corners[i + 2].position };
+			// The cross product's length is twice the area, so larger faces count more.
+			dvec3 n = glm::cross(obj.positions[I[1]] - obj.positions[I[0]],
+								obj.positions[I[2]] - obj.positions[I[0]]);
+			for (int j = 0; j < 3; j++) {
+				smoothNormals[I[j]] += n;
 			}
-			faceCount++;
 		}
 	}
 
-	// Constructs the triangles from the vertices
-	for (int i = 0; i < faces.size(); i++) {
-		Material mat = redPlastic;
-		dvec4 A = vertices.at(faces.at(i).x - 1);
-		dvec4 B = vertices.at(faces.at(i).y - 1);
-		dvec4 C = vertices.at(faces.at(i).z - 1);
-		VertexData::addTriVertsAndComputeNormal(result, A, B, C, mat);
+	// The vertices made for a position are chained, so finding a corner's vertex
+	// only compares against the few vertices that share its position.
+	const uint16_t MAT = MaterialPalette::idOf(redPlastic);
+	vector<int32_t> firstVertex(obj.positions.size(), -1);
+	vector<int32_t> nextVertex;
+	vector<ObjCorner> vertexCorners;
+	result.vertices.reserve(obj.positions.size());
+	result.indices.reserve(obj.corners.size());
+	for (const ObjCorner& corner : obj.corners) {
+		int32_t v = firstVertex[corner.position];
+		while (v >= 0 && (vertexCorners[v].texCoord != corner.texCoord ||
+							vertexCorners[v].normal != corner.normal)) {
+			v = nextVertex[v];
+		}
+		if (v < 0) {
+			v = (int32_t)result.vertices.size();
+			dvec3 n = corner.normal != ObjCorner::NONE ? obj.normals[corner.normal]
+														: smoothNormals[corner.position];
+			n = glm::length(n) > 0.0 ? glm::normalize(n) : Y_AXIS;
+			result.vertices.push_back(VertexData(dvec4(obj.positions[corner.position], 1.0), n, MAT, ORIGIN3D));
+			if (corner.texCoord != ObjCorner::NONE) {
+				result.vertices.back().texCoord = obj.texCoords[corner.texCoord];
+			}
+			vertexCorners.push_back(corner);
+			nextVertex.push_back(firstVertex[corner.position]);
+			firstVertex[corner.position] = v;
+		}
+		result.indices.push_back((uint32_t)v);
 	}
 
+	result.bounds = BoundingSphere::enclosing(result.vertices);
 	return result;
-}
\ No newline at end of file
+}
@@ -15,7 +15,49 @@
 #include "framebuffer.h"
 #include "light.h"
 
-typedef vector<VertexData> EShapeData;
+/**
+ * @struct	BoundingSphere
+ * @brief	A sphere enclosing every vertex of a shape, in object coordinates. A
+ *			negative radius means the bound is unknown.
+ */
+
+struct BoundingSphere {
+	dvec3 center;	//!< Center of the sphere
+	double radius;	//!< Radius of the sphere; negative if unknown
+	BoundingSphere() : center(0.0, 0.0, 0.0), radius(-1.0) {}
+	static BoundingSphere enclosing(const vector<VertexData>& vertices);
+};
+
+/**
+ * @struct	EShapeData
+ * @brief	The vertices of a shape; each triplet is a triangle. The EShape
+ *			generators also fill in the bounding sphere, which lets VertexOps::render
+ *			skip shapes that are out of view. Call computeBounds after changing the
+ *			vertices of a shape.
+ */
+
+struct EShapeData : public vector<VertexData> {
+	BoundingSphere bounds;	//!< Encloses every vertex
+	void computeBounds() { bounds = BoundingSphere::enclosing(*this); }
+};
+
+/**
+ * @struct	IndexedMesh
+ * @brief	A triangle mesh in which each distinct vertex is stored once and
+ *			triangles refer to vertices by index. Vertices shared by several
+ *			triangles are then transformed once per draw rather than once per
+ *			triangle (see VertexOps::render).
+ */
+
+struct IndexedMesh {
+	vector<VertexData> vertices;	//!< Each distinct vertex, once
+	vector<uint32_t> indices;		//!< Three per triangle, indexing vertices
+	BoundingSphere bounds;			//!< Encloses every vertex
+	IndexedMesh() {}
+	explicit IndexedMesh(const EShapeData& triangles);
+	size_t numTriangles() const { return indices.size() / 3; }
+	EShapeData toTriangles() const;
+};
 
 /**
  * @struct	EShape
@@ -33,4 +75,5 @@ struct EShape {
 	static EShapeData createECone(const Material& mat, int slices = DEFAULT_SLICES);
 	static EShapeData createECheckerBoard(const Material& mat1, const Material& mat2, double WIDTH, double HEIGHT, int DIV);
 	static EShapeData createEObj(const string& filename);
+	static IndexedMesh createEObjIndexed(const string& filename);
 };
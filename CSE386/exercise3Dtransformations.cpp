@@ -14,6 +14,7 @@
 #include "io.h"
 #include "light.h"
 #include "vertexops.h"
+#include "drawcommands.h"
 
 const int W = 500;
 const int H = 250;
@@ -50,19 +51,24 @@ EShapeData cyl1 = EShape::createECylinder(LG, DEFAULT_SLICES);
 EShapeData cyl2 = EShape::createECylinder(LG, DEFAULT_SLICES);
 EShapeData tri = EShape::createETriangle(C,
 				dvec4(0, 0, 0, 1), dvec4(1, 0, 0, 1), dvec4(1, 1, 0, 1));
-//EShapeData mario = EShape::createEObj("mario.obj");
-//EShapeData teapot = EShape::createEObj("teapot.obj");
+//IndexedMesh mario = EShape::createEObjIndexed("mario.obj");
+//IndexedMesh teapot = EShape::createEObjIndexed("teapot.obj");
+DrawCommandBuffer drawCommands;
 
 void renderObjects() {
-	VertexOps::render(frameBuffer, plane, lights, dmat4(), pipeMats, true);
-	VertexOps::render(frameBuffer, cone1, lights, T(-1, 2, 0) * Rx(angle) * S(0.25), pipeMats, true);
-	VertexOps::render(frameBuffer, cone2, lights, Ry(angle) * T(2, 1, 0) * Rx(angle), pipeMats, true);
-	VertexOps::render(frameBuffer, disk, lights, T(0, 1, 0) * Ry(angle) * S(0.5), pipeMats, true);
-	VertexOps::render(frameBuffer, cyl1, lights, T(2, 0, 0), pipeMats, true);
-	VertexOps::render(frameBuffer, cyl2, lights, T(-2, 1, 0) * Rx(PI_2), pipeMats, true);
-	VertexOps::render(frameBuffer, tri, lights, T(0, 2, 0) * Rx(angle), pipeMats, true);
-	//VertexOps::render(frameBuffer, mario, lights, T(0, 0, 0) * Ry(angle) * S(0.01), pipeMats, true);
-	//VertexOps::render(frameBuffer, teapot, lights, T(0, -1, 0), pipeMats, true);
+	// The objects move, so they are recorded again every frame. submit culls
+	// them and sorts them front to back; press S to compare with recorded order.
+	drawCommands.clear();
+	drawCommands.draw(plane, dmat4());
+	drawCommands.draw(cone1, T(-1, 2, 0) * Rx(angle) * S(0.25));
+	drawCommands.draw(cone2, Ry(angle) * T(2, 1, 0) * Rx(angle));
+	drawCommands.draw(disk, T(0, 1, 0) * Ry(angle) * S(0.5));
+	drawCommands.draw(cyl1, T(2, 0, 0));
+	drawCommands.draw(cyl2, T(-2, 1, 0) * Rx(PI_2));
+	drawCommands.draw(tri, T(0, 2, 0) * Rx(angle));
+	//drawCommands.draw(mario, T(0, 0, 0) * Ry(angle) * S(0.01));
+	//drawCommands.draw(teapot, T(0, -1, 0));
+	drawCommands.submit(frameBuffer, lights, pipeMats);
 }
 
 static void render(GLFWwindow* window) {
@@ -90,6 +96,14 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods) {
 		case GLFW_KEY_P:
 			isMoving = !isMoving;
 			break;
+		case GLFW_KEY_S:
+			drawCommands.sortingOn = !drawCommands.sortingOn;
+			cout << "Depth sorting: " << (drawCommands.sortingOn ? "on" : "off") << endl;
+			break;
+		case GLFW_KEY_X:
+			fixedPointRasterization = !fixedPointRasterization;
+			cout << "Fixed-point rasterization: " << (fixedPointRasterization ? "on" : "off") << endl;
+			break;
 		case GLFW_KEY_ESCAPE:
 			exit(0);
 	}
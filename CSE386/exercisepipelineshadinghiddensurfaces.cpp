@@ -9,11 +9,14 @@
 
 #include <ctime> 
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include "io.h"
+#include "image.h"
 #include "eshape.h"
 #include "light.h"
 #include "vertexops.h"
+#include "drawcommands.h"
 
 const int W = 600;
 const int H = 300;
@@ -21,6 +24,8 @@ const int H = 300;
 PositionalLightPtr theLight = new PositionalLight(dvec3(0, 10, 4), white);
 vector<LightSourcePtr> lights = { theLight };
 FrameBuffer frameBuffer(W, H);
+GBuffer gBuffer(W, H);
+bool deferredShadingOn = false;
 
 PipelineMatrices pipeMats;
 dmat4& viewingMatrix = pipeMats.viewingMatrix;
@@ -35,37 +40,160 @@ EShapeData tri1 = EShape::createETriangle(gold, A, B, C);
 EShapeData tri2 = EShape::createETriangle(polishedCopper, A, B, C);
 EShapeData tri3 = EShape::createETriangle(cyanPlastic, A, B, C);
 EShapeData cone = EShape::createECone(pewter, 8);
+DrawCommandBuffer drawCommands(false);
 
-void renderObjects() {
+void recordObjects() {
 	// The rendering should work regardless of the order in which
-	// the objects are rendered.
-	VertexOps::render(frameBuffer, board, lights, glm::dmat4(), pipeMats, true);
-	VertexOps::render(frameBuffer, tri1, lights, T(0, 2, 0) * S(5, 2, 1), pipeMats, true);
-	VertexOps::render(frameBuffer, tri2, lights, T(-1, 0, 0) * Ry(-PI_3) * S(10, 3, 1), pipeMats, true);
-	VertexOps::render(frameBuffer, tri3, lights, T(0, 1, 0) * S(8, 1, 1) * Ry(PI_4) * Rz(PI_2), pipeMats, true);
-	VertexOps::render(frameBuffer, cone, lights, T(-3, 0, 3), pipeMats, true);
+	// the objects are rendered, so the buffer does not sort them.
+	drawCommands.draw(board, glm::dmat4());
+	drawCommands.draw(tri1, T(0, 2, 0) * S(5, 2, 1));
+	drawCommands.draw(tri2, T(-1, 0, 0) * Ry(-PI_3) * S(10, 3, 1));
+	drawCommands.draw(tri3, T(0, 1, 0) * S(8, 1, 1) * Ry(PI_4) * Rz(PI_2));
+	drawCommands.draw(cone, T(-3, 0, 3));
 }
 
-void render(GLFWwindow* window) {
+void renderObjects() {
+	drawCommands.submit(frameBuffer, lights, pipeMats);
+}
+
+dvec3 eyePosition(0, 5, 5);
+
+/**
+ * @fn	void renderFrame()
+ * @brief	Renders the scene into the frame buffer, from eyePosition, with forward
+ *			or deferred shading. Does not display it.
+ */
+
+void renderFrame() {
 	frameBuffer.clearColorAndDepthBuffers();
 	int width = frameBuffer.getWindowWidth();
 	int height = frameBuffer.getWindowHeight();
+	if (deferredShadingOn) {
+		gBuffer.setSize(width, height);
+		gBuffer.clear();
+		FragmentOps::gBuffer = &gBuffer;
+	} else {
+		FragmentOps::gBuffer = nullptr;
+	}
 
 	double AR = (double)width / height;
 
-	viewingMatrix = glm::lookAt(glm::dvec3(0, 5, 5), glm::dvec3(0, 0, 0), Y_AXIS);
+	viewingMatrix = glm::lookAt(eyePosition, glm::dvec3(0, 0, 0), Y_AXIS);
 	projectionMatrix = glm::perspective(PI_3, AR, 0.5, 80.0);
 	viewportMatrix = VertexOps::getViewportTransformation(0, width, 0, height);
 
 	renderObjects();
+	if (deferredShadingOn) {
+		pipeMats.refresh();
+		FragmentOps::shadeGBuffer(frameBuffer, ShadingContext(pipeMats.eyePos, pipeMats.eyeFrame, lights));
+	}
+}
+
+void render(GLFWwindow* window) {
+	renderFrame();
+	int width = frameBuffer.getWindowWidth();
+	int height = frameBuffer.getWindowHeight();
 	frameBuffer.showAxes(viewingMatrix, projectionMatrix, viewportMatrix,
 		BoundingBoxi(0, width, 0, height));
 	frameBuffer.showColorBuffer();
 }
 
+/**
+ * @struct	ReferenceScene
+ * @brief	A view of the scene used to compare the float and double pixel buffer builds.
+ */
+
+struct ReferenceScene {
+	string name;		//!< Used in the image's file name
+	dvec3 eye;			//!< Where the camera is
+	bool deferred;		//!< Whether deferred shading is used
+};
+
+const ReferenceScene REFERENCE_SCENES[] = {
+	{ "forward", dvec3(0, 5, 5), false },
+	{ "deferred", dvec3(0, 5, 5), true },
+	{ "grazing_forward", dvec3(0, 0.5, 12), false },
+	{ "grazing_deferred", dvec3(0, 0.5, 12), true },
+};
+
+/**
+ * @fn	int renderReferenceScenes()
+ * @brief	Renders each reference scene without a window and saves it as
+ *			reference_<scene>_<precision>.ppm, where precision is PIXEL_REAL_NAME.
+ *			For each scene that the build with the other pixel buffer precision has
+ *			already saved, reports how far the float image is from the double one.
+ *			Run with --reference from both builds, in either order; the second run
+ *			prints the comparison. First, checks that the AVX2
+ *			and scalar rasterizers cover the same pixels (see checkBlockCoverage).
+ * @return	The exit status: 0 unless the coverage check failed or an image could
+ *			not be written or compared.
+ */
+
+int renderReferenceScenes() {
+	const string OTHER_NAME = PIXEL_REAL_NAME == "double" ? "float" : "double";
+	int status = 0;
+
+	const int NUM_TRIANGLES = 10000;
+	int badTriangles = checkBlockCoverage(NUM_TRIANGLES);
+	if (badTriangles < 0) {
+		cout << "Block coverage: not checked, since the CPU has no AVX2" << endl;
+	} else if (badTriangles > 0) {
+		cout << "Error: " << badTriangles << " of " << NUM_TRIANGLES
+			<< " triangles are covered differently by the AVX2 and scalar rasterizers" << endl;
+		status = 1;
+	} else {
+		cout << "Block coverage: AVX2 and scalar rasterizers agree" << endl;
+	}
+
+	for (const ReferenceScene& scene : REFERENCE_SCENES) {
+		eyePosition = scene.eye;
+		deferredShadingOn = scene.deferred;
+		renderFrame();
+		const string prefix = "reference_" + scene.name + "_";
+		if (!frameBuffer.writePPM(prefix + PIXEL_REAL_NAME + ".ppm")) {
+			cout << "Error: Cannot write " << prefix << PIXEL_REAL_NAME << ".ppm" << endl;
+			status = 1;
+			continue;
+		}
+		if (!std::ifstream(prefix + OTHER_NAME + ".ppm").good()) {
+			cout << scene.name << ": saved " << PIXEL_REAL_NAME << " image" << endl;
+			continue;
+		}
+		Image doubleImage(prefix + "double.ppm");
+		Image floatImage(prefix + "float.ppm");
+		ImageDifference diff = ImageDifference::compare(doubleImage, floatImage);
+		cout << scene.name << ": float vs. double: " << diff << endl;
+		if (!diff.valid) {
+			status = 1;
+		}
+	}
+	return status;
+}
+
+void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if (action != GLFW_PRESS)
+		return;
+
+	switch (key) {
+	case GLFW_KEY_D:
+		deferredShadingOn = !deferredShadingOn;
+		cout << "Deferred shading: " << (deferredShadingOn ? "on" : "off") << endl;
+		break;
+	case GLFW_KEY_ESCAPE:
+		glfwSetWindowShouldClose(window, GLFW_TRUE);
+		break;
+	default:
+		cout << (int)key << "unmapped key pressed." << endl;
+	}
+}
+
 int main(int argc, char* argv[]) {
 	frameBuffer.setClearColor(paleGreen);
-	initGraphics(W, H, username.c_str(), render, nullptr, keyboardUtility, nullptr);
+	recordObjects();
+	if (argc > 1 && string(argv[1]) == "--reference") {
+		return renderReferenceScenes();
+	}
+	initGraphics(W, H, username.c_str(), render, nullptr, keyboard, nullptr);
 
 	return 0;
 }
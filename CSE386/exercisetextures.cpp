@@ -21,12 +21,14 @@
 #include "camera.h"
 #include "image.h"
 #include "io.h"
+#include "framecapture.h"
 using namespace std::chrono;
 
 const int W = 400;
 const int H = 400;
 
 FrameBuffer frameBuffer(W, H);
+FrameCapture* capture = nullptr;
 Image im("usflag.ppm");
 
 double angle = 0.0;
@@ -75,6 +77,7 @@ void render(GLFWwindow* window) {
 	frameBuffer.clearColorBuffer();
 	rayTrace.raytraceScene(frameBuffer, 0, theScene);
 	frameBuffer.showColorBuffer();
+	frameBuffer.captureFrame();
 
 	milliseconds frameEndTime = duration_cast<milliseconds>(
 		system_clock::now().time_since_epoch()
@@ -89,6 +92,17 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods) {
 
 	if (key == GLFW_KEY_P) {
 		isAnimated = !isAnimated;
+	} else if (key == GLFW_KEY_R) {
+		if (capture == nullptr) {
+			capture = new FrameCapture("orbit.y4m", CaptureFormat::Y4M, 10);
+		} else {
+			delete capture;
+			capture = nullptr;
+		}
+		frameBuffer.setCaptureSink(capture);
+	} else if (key == GLFW_KEY_ESCAPE) {
+		delete capture;
+		exit(0);
 	}
 }
 
@@ -96,5 +110,6 @@ int main(int argc, char* argv[]) {
 	buildScene();
 	frameBuffer.setClearColor(paleGreen);
 	initGraphics(W, H, username.c_str(), render, mouseUtility, keyboard, nullptr);
+	delete capture;
 	return 0;
 }
\ No newline at end of file
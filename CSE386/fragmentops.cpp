@@ -9,8 +9,12 @@
 
 #include <vector>
 #include "fragmentops.h"
+#include "workerpool.h"
 
 FogParams FragmentOps::fogParams;
+GBuffer* FragmentOps::gBuffer = nullptr;
+unsigned int FragmentOps::varyings = VARYING_NORMAL | VARYING_WORLD_POS;
+const uint16_t GBuffer::NO_MATERIAL;
 bool FragmentOps::performDepthTest = true;
 bool FragmentOps::readonlyDepthBuffer = false;
 bool FragmentOps::readonlyColorBuffer = false;
@@ -30,18 +34,23 @@ double FogParams::fogFactor(const dvec3& fragPos, const dvec3& eyePos) const {
 }
 
 /**
- * @fn	color FragmentOps::applyFog(const color &destColor, const dvec3 &eyePos, const dvec3 &fragPos)
+ * @fn	color FragmentOps::applyFog(const FogParams &fog, const color &destColor,
+ *									const dvec3 &eyePos, const dvec3 &fragPos)
  * @brief	Applies fog to a fragment.
+ * @param	fog		 	The fog to apply.
  * @param	destColor	Destination color.
  * @param	eyePos   	Eye position.
  * @param	fragPos  	Fragment position.
  * @return	The color after applying the fog.
  */
 
-color FragmentOps::applyFog(const color& destColor,
+color FragmentOps::applyFog(const FogParams& fog, const color& destColor,
 	const dvec3& eyePos, const dvec3& fragPos) {
-	/* CSE 386 - todo  */
-	return destColor;
+	if (fog.type == FogType::NO_FOG) {
+		return destColor;
+	}
+	double f = glm::clamp(fog.fogFactor(fragPos, eyePos), 0.0, 1.0);
+	return f * destColor + (1.0 - f) * fog.color;
 }
 
 /**
@@ -58,32 +67,282 @@ color FragmentOps::applyBlending(double alpha, const color& srcColor, const colo
 	return srcColor;
 }
 
+/**
+ * @fn	ShadingContext::ShadingContext(const dvec3 &eyePos, const Frame &eyeFrame,
+ *										const vector<LightSourcePtr> &lights)
+ * @brief	Constructs the shading context for a draw, capturing the current
+ *			FragmentOps settings. The lights are referenced, not copied, and must
+ *			outlive the context.
+ * @param	eyePos  	Eye position in world coordinates.
+ * @param	eyeFrame	The camera's frame.
+ * @param	lights  	Vector of lights in scene.
+ */
+
+ShadingContext::ShadingContext(const dvec3& eyePos, const Frame& eyeFrame,
+	const vector<LightSourcePtr>& lights)
+	: eyePos(eyePos), eyeFrame(eyeFrame), lights(lights),
+	fog(FragmentOps::fogParams),
+	performDepthTest(FragmentOps::performDepthTest),
+	readonlyDepthBuffer(FragmentOps::readonlyDepthBuffer),
+	readonlyColorBuffer(FragmentOps::readonlyColorBuffer),
+	gBuffer(FragmentOps::gBuffer),
+	layout(FragmentOps::varyings |
+		(FragmentOps::gBuffer != nullptr ? VARYING_NORMAL | VARYING_WORLD_POS : 0)) {
+	if (gBuffer != nullptr && (layout.mask & VARYING_COLOR)) {
+		gBuffer->storeBlendedMaterials();
+	}
+}
+
 /**
  * @fn	void FragmentOps::processFragment(FrameBuffer &frameBuffer,
- *											const dvec3 &eyePositionInWorldCoords,
- *											const vector<LightSourcePtr> lights,
- *											const Fragment &fragment,
- *											const dmat4 &viewingMatrix)
- * @brief	Process the fragment, leaving the results in the framebuffer.
- * @param [in,out]	frameBuffer	                The frame buffer
- * @param 		  	eyePositionInWorldCoords	The eye position in world coordinates.
- * @param 		  	lights						Vector of lights in scene.
- * @param 		  	fragment					Fragment to be processed.
- * @param           eyeFrame                    The camera's frame.
- */
-
- void FragmentOps::processFragment(FrameBuffer &frameBuffer, const dvec3 &eyePositionInWorldCoords,
- 										const vector<LightSourcePtr> lights,
- 										const Fragment &fragment,
- 										const Frame &eyeFrame) {
- 	const dvec3 &eyePos = eyePositionInWorldCoords;
- 
- 	double Z = fragment.windowPos.z;
- 	int X = (int)fragment.windowPos.x;
- 	int Y = (int)fragment.windowPos.y;
- 	DEBUG_PIXEL = (X == xDebug && Y == yDebug);
-
-	color C = fragment.material.diffuse;
-	frameBuffer.setColor(X, Y, C);
-	frameBuffer.setDepth(X, Y, Z);
- }
+ *											const ShadingContext &context,
+ *											const Fragment &fragment)
+ * @brief	Process the fragment, leaving the results in the framebuffer. The
+ *			fragment is shaded by shadeFragment, as in deferred shading. The color
+ *			and depth are only written if the context allows it.
+ * @param [in,out]	frameBuffer	The frame buffer
+ * @param 		  	context	   	The draw's shading context; lights, eye and fog.
+ * @param 		  	fragment   	Fragment to be processed.
+ */
+
+void FragmentOps::processFragment(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const Fragment& fragment) {
+	double Z = fragment.windowPos.z;
+	int X = (int)fragment.windowPos.x;
+	int Y = (int)fragment.windowPos.y;
+	DEBUG_PIXEL = (X == xDebug && Y == yDebug);
+
+	if (!context.readonlyColorBuffer) {
+		frameBuffer.setColor(X, Y, shadeFragment(context, fragment));
+	}
+	if (!context.readonlyDepthBuffer) {
+		frameBuffer.setDepth(X, Y, Z);
+	}
+}
+
+/**
+ * @fn	color FragmentOps::shadeFragment(const ShadingContext &context, const Fragment &fragment)
+ * @brief	Computes the final color of a fragment: lighting, then fog. Both the
+ *			forward path (processFragment) and deferred shading (shadeGBuffer) use
+ *			it, so switching between them changes the cost but not the image.
+ * @param	context 	The draw's shading context; lights, eye and fog.
+ * @param	fragment	The fragment.
+ * @return	The color of the fragment.
+ */
+
+color FragmentOps::shadeFragment(const ShadingContext& context, const Fragment& fragment) {
+	color C = applyLighting(fragment, context.eyePos, context.lights, context.eyeFrame);
+	return applyFog(context.fog, C, context.eyePos, fragment.worldPos);
+}
+
+/**
+ * @fn	color FragmentOps::applyLighting(const Fragment &fragment,
+ *										const dvec3 &eyePositionInWorldCoords,
+ *										const vector<LightSourcePtr> &lights,
+ *										const Frame &eyeFrame)
+ * @brief	Computes the color of a fragment, summing the contribution of every light.
+ * @param	fragment				The fragment.
+ * @param	eyePositionInWorldCoords	The eye position in world coordinates.
+ * @param	lights					Vector of lights in scene.
+ * @param	eyeFrame				The camera's frame.
+ * @return	The lit color.
+ */
+
+color FragmentOps::applyLighting(const Fragment& fragment,
+	const dvec3& eyePositionInWorldCoords,
+	const vector<LightSourcePtr>& lights,
+	const Frame& eyeFrame) {
+	dvec3 n = glm::normalize(fragment.worldNormal);
+	color C = black;
+	for (const LightSourcePtr& light : lights) {
+		C += light->illuminate(fragment.worldPos, n, fragment.getMaterial(),
+			eyePositionInWorldCoords, false);
+	}
+	return glm::clamp(C, 0.0, 1.0);
+}
+
+/**
+ * @fn	void FragmentOps::shadeGBuffer(FrameBuffer &frameBuffer, const ShadingContext &context)
+ * @brief	The lighting pass of deferred shading. Shades every pixel of the context's
+ *			G-buffer that something was drawn on, exactly once, and writes the result
+ *			to the color buffer. Rows are split among the WorkerPool's threads.
+ * @param [in,out]	frameBuffer	The frame buffer
+ * @param 		  	context	   	Lights, eye, fog and the G-buffer to shade.
+ */
+
+void FragmentOps::shadeGBuffer(FrameBuffer& frameBuffer, const ShadingContext& context) {
+	if (context.gBuffer == nullptr || context.readonlyColorBuffer) {
+		return;
+	}
+	const GBuffer& G = *context.gBuffer;
+	const int W = std::min(G.getWidth(), frameBuffer.getWindowWidth());
+	const int H = std::min(G.getHeight(), frameBuffer.getWindowHeight());
+	const int NUM_THREADS = WorkerPool::shared().size();
+
+	auto shadeRows = [&](int firstRow) {
+		Fragment fragment;
+		for (int y = firstRow; y < H; y += NUM_THREADS) {
+			for (int x = 0; x < W; x++) {
+				int i = y * G.getWidth() + x;
+				if (G.materialIDs[i] == GBuffer::NO_MATERIAL) {
+					continue;
+				}
+				fragment.windowPos = dvec3(x, y, frameBuffer.getDepth(x, y));
+				fragment.materialID = G.materialIDs[i];
+				if (fragment.materialID == MaterialPalette::BLENDED) {
+					fragment.blendedMaterial = G.blendedMaterials[i];
+				}
+				fragment.worldNormal = dvec3(G.normals[i]);
+				fragment.worldPos = dvec3(G.worldPositions[i]);
+				frameBuffer.setColor(x, y, shadeFragment(context, fragment));
+			}
+		}
+	};
+	WorkerPool::shared().run(NUM_THREADS, shadeRows);
+}
+
+/**
+ * @fn	GBuffer::GBuffer(int width, int height)
+ * @brief	Constructor
+ * @param	width 	The width.
+ * @param	height	The height.
+ */
+
+GBuffer::GBuffer(int width, int height) : width(0), height(0) {
+	setSize(width, height);
+}
+
+/**
+ * @fn	void GBuffer::setSize(int width, int height)
+ * @brief	Sets the size of the G-buffer, which should match the framebuffer. Clears
+ *			the G-buffer if the size changes.
+ * @param	width 	The width.
+ * @param	height	The height.
+ */
+
+void GBuffer::setSize(int width, int height) {
+	if (width == this->width && height == this->height) {
+		return;
+	}
+	this->width = width;
+	this->height = height;
+	normals.resize(width * height);
+	worldPositions.resize(width * height);
+	materialIDs.resize(width * height);
+	if (!blendedMaterials.empty()) {
+		blendedMaterials.resize(width * height);
+	}
+	clear();
+}
+
+/**
+ * @fn	void GBuffer::clear()
+ * @brief	Marks every pixel as empty. Call at the
+ *			start of each frame, along with clearing the framebuffer's depth buffer.
+ */
+
+void GBuffer::clear() {
+	std::fill(materialIDs.begin(), materialIDs.end(), NO_MATERIAL);
+}
+
+/**
+ * @fn	void GBuffer::storeBlendedMaterials()
+ * @brief	Makes room for an interpolated material at every pixel. Called when a
+ *			draw declares VARYING_COLOR, before any of its fragments are written.
+ */
+
+void GBuffer::storeBlendedMaterials() {
+	if (blendedMaterials.size() != normals.size()) {
+		blendedMaterials.resize(normals.size());
+	}
+}
+
+/**
+ * @fn	void GBuffer::write(int x, int y, const Fragment &fragment)
+ * @brief	Stores the surface seen at pixel (x, y).
+ * @param	x		  	The x coordinate.
+ * @param	y		  	The y coordinate.
+ * @param	fragment	The fragment: its world normal, world position and material.
+ */
+
+void GBuffer::write(int x, int y, const Fragment& fragment) {
+	if (x < 0 || y < 0 || x >= width || y >= height) {
+		return;
+	}
+	int i = y * width + x;
+	normals[i] = pvec3(fragment.worldNormal);
+	worldPositions[i] = pvec3(fragment.worldPos);
+	materialIDs[i] = fragment.materialID;
+	if (fragment.materialID == MaterialPalette::BLENDED && !blendedMaterials.empty()) {
+		blendedMaterials[i] = fragment.blendedMaterial;
+	}
+}
+
+/**
+ * @fn	VaryingLayout::VaryingLayout(unsigned int mask)
+ * @brief	Lays out the declared varyings one after another.
+ * @param	mask	Varying flags.
+ */
+
+VaryingLayout::VaryingLayout(unsigned int mask) : mask(mask), size(0) {
+	if (mask & VARYING_NORMAL) size += 3;
+	if (mask & VARYING_WORLD_POS) size += 3;
+	if (mask & VARYING_UV) size += 2;
+	if (mask & VARYING_COLOR) size += 10;
+}
+
+/**
+ * @fn	void VaryingLayout::pack(const VertexData &v, float *out) const
+ * @brief	Copies the declared attributes of a vertex into a flat array.
+ * @param 		  	v  	The vertex.
+ * @param [out]	out	size floats.
+ */
+
+void VaryingLayout::pack(const VertexData& v, float* out) const {
+	auto put = [&out](const dvec3& a) {
+		*out++ = (float)a.x;
+		*out++ = (float)a.y;
+		*out++ = (float)a.z;
+	};
+	if (mask & VARYING_NORMAL) put(v.normal);
+	if (mask & VARYING_WORLD_POS) put(v.worldPos);
+	if (mask & VARYING_UV) {
+		*out++ = (float)v.texCoord.x;
+		*out++ = (float)v.texCoord.y;
+	}
+	if (mask & VARYING_COLOR) {
+		const Material& M = v.getMaterial();
+		put(M.ambient);
+		put(M.diffuse);
+		put(M.specular);
+		*out++ = (float)M.shininess;
+	}
+}
+
+/**
+ * @fn	void VaryingLayout::unpack(const float *in, Fragment &fragment) const
+ * @brief	Copies interpolated attributes into a fragment.
+ * @param 		  	in		 	size floats, as laid out by pack.
+ * @param [in,out]	fragment	The fragment. Only declared attributes are set.
+ */
+
+void VaryingLayout::unpack(const float* in, Fragment& fragment) const {
+	auto get = [&in]() {
+		dvec3 a(in[0], in[1], in[2]);
+		in += 3;
+		return a;
+	};
+	if (mask & VARYING_NORMAL) fragment.worldNormal = get();
+	if (mask & VARYING_WORLD_POS) fragment.worldPos = get();
+	if (mask & VARYING_UV) {
+		fragment.texCoord = dvec2(in[0], in[1]);
+		in += 2;
+	}
+	if (mask & VARYING_COLOR) {
+		fragment.materialID = MaterialPalette::BLENDED;
+		fragment.blendedMaterial.ambient = get();
+		fragment.blendedMaterial.diffuse = get();
+		fragment.blendedMaterial.specular = get();
+		fragment.blendedMaterial.shininess = *in++;
+	}
+}
@@ -10,6 +10,7 @@
 #pragma once
 #include "framebuffer.h"
 #include "light.h"
+#include "vertexdata.h"
 
  /**
   * @enum	FogType
@@ -40,13 +41,106 @@ struct FogParams {
  * @struct	Fragment
  * @brief	Represents the information relevant to a single fragment. Think
  * 			of a fragment as a pixel competing to get into the framebuffer.
+ *			The material is a palette id, unless VARYING_COLOR is declared, in
+ *			which case it is interpolated into blendedMaterial.
  */
 
 struct Fragment {
-	dvec3 windowPos;	//!< (x, y) is window coordinate. z is depth.
-	Material material;	//!< Material to use
-	dvec3 worldNormal;	//!< Transformed normal vector from early in pipeline
-	dvec3 worldPos;		//!< Saved position from early in the pipeline
+	dvec3 windowPos;			//!< (x, y) is window coordinate. z is depth.
+	uint16_t materialID;		//!< MaterialPalette id, or MaterialPalette::BLENDED
+	Material blendedMaterial;	//!< Interpolated material, when materialID is BLENDED
+	dvec3 worldNormal;			//!< Transformed normal vector from early in pipeline
+	dvec3 worldPos;				//!< Saved position from early in the pipeline
+	dvec2 texCoord;				//!< Texture coordinates
+
+	const Material& getMaterial() const {
+		return materialID == MaterialPalette::BLENDED ? blendedMaterial : MaterialPalette::get(materialID);
+	}
+};
+
+/**
+ * @enum	Varying
+ * @brief	The vertex attributes that can be interpolated across a primitive. A
+ *			draw declares the ones its shading needs in FragmentOps::varyings.
+ */
+
+enum Varying : unsigned int {
+	VARYING_NORMAL = 1,			//!< World normal (3 floats)
+	VARYING_WORLD_POS = 2,		//!< World position (3 floats)
+	VARYING_UV = 4,				//!< Texture coordinates (2 floats)
+	VARYING_COLOR = 8,			//!< Blended material colors and shininess (10 floats)
+	VARYING_ALL = 15
+};
+
+/**
+ * @struct	VaryingLayout
+ * @brief	Where each declared varying lives in a flat array of floats. Vertices
+ *			are packed once per draw; the rasterizer then interpolates size floats
+ *			per pixel, no matter which attributes they hold. Undeclared attributes
+ *			are left alone by unpack.
+ */
+
+struct VaryingLayout {
+	static const int MAX_FLOATS = 18;	//!< Size when every varying is declared
+	unsigned int mask;					//!< The declared varyings
+	int size;							//!< Number of floats per vertex
+
+	explicit VaryingLayout(unsigned int mask);
+	void pack(const VertexData& v, float* out) const;
+	void unpack(const float* in, Fragment& fragment) const;
+};
+
+/**
+ * @struct	GBuffer
+ * @brief	Geometry buffer for deferred shading. Instead of shading each fragment
+ *			as it arrives, the rasterizer stores what lighting needs at each pixel;
+ *			depth goes in the framebuffer's depth buffer as usual. Lighting is then
+ *			done once per visible pixel by FragmentOps::shadeGBuffer, with the same
+ *			shading as the forward path. Materials are stored as MaterialPalette ids;
+ *			when VARYING_COLOR is declared, pixels with id BLENDED keep their
+ *			interpolated material in blendedMaterials.
+ */
+
+struct GBuffer {
+	static const uint16_t NO_MATERIAL = MaterialPalette::NONE;	//!< Id of pixels nothing was drawn on
+
+	GBuffer(int width, int height);
+	void setSize(int width, int height);
+	void clear();
+	void write(int x, int y, const Fragment& fragment);
+	void storeBlendedMaterials();
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	vector<pvec3> normals;			//!< World normal at each pixel (not normalized)
+	vector<pvec3> worldPositions;	//!< World position at each pixel
+	vector<uint16_t> materialIDs;	//!< MaterialPalette id at each pixel, or NO_MATERIAL
+	vector<Material> blendedMaterials;	//!< Material of each BLENDED pixel; empty until needed
+protected:
+	int width, height;
+};
+
+/**
+ * @struct	ShadingContext
+ * @brief	Everything the fragment stage needs that stays the same for a whole draw:
+ *			the lights, the eye, and the fog, depth and G-buffer state. It is built
+ *			once per VertexOps::render call and passed by reference down to each
+ *			fragment, so nothing is copied or allocated per fragment. The FragmentOps
+ *			flags are read when the context is built.
+ */
+
+struct ShadingContext {
+	ShadingContext(const dvec3& eyePos, const Frame& eyeFrame,
+		const vector<LightSourcePtr>& lights);
+	dvec3 eyePos;						//!< Eye position in world coordinates
+	Frame eyeFrame;						//!< The camera's frame
+	const vector<LightSourcePtr>& lights;	//!< Lights in the scene
+	FogParams fog;						//!< Fog to apply
+	bool performDepthTest;				//!< True ==> use depth buffer
+	bool readonlyDepthBuffer;			//!< True ==> rendering will not affect depth buffer
+	bool readonlyColorBuffer;			//!< True ==> rendering will not affect color buffer
+	GBuffer* gBuffer;					//!< Non-null ==> deferred shading into this G-buffer
+	VaryingLayout layout;				//!< Layout of the varyings the draw interpolates
 };
 
 /**
@@ -60,12 +154,14 @@ public:
 	static bool readonlyDepthBuffer;	//!< True ==> rendering will not affect depth buffer. Typically false
 	static bool readonlyColorBuffer;	//!< True ==> rendering will not affect color buffer. Typically false
 	static FogParams fogParams;			//!< Parameters controlling fog effects.
-	static void processFragment(FrameBuffer& frameBuffer, const dvec3& eyePositionInWorldCoords,
-		const vector<LightSourcePtr> lights,
-		const Fragment& fragment,
-		const Frame& eyeFrame);
+	static GBuffer* gBuffer;			//!< Non-null ==> deferred shading into this G-buffer
+	static unsigned int varyings;		//!< Varying flags; attributes the shading needs
+	static void processFragment(FrameBuffer& frameBuffer, const ShadingContext& context,
+		const Fragment& fragment);
+	static void shadeGBuffer(FrameBuffer& frameBuffer, const ShadingContext& context);
 protected:
-	static color applyFog(const color& destColor,
+	static color shadeFragment(const ShadingContext& context, const Fragment& fragment);
+	static color applyFog(const FogParams& fog, const color& destColor,
 		const dvec3& eyePos, const dvec3& fragPos);
 	static color applyBlending(double alpha, const color& src, const color& dest);
 	static color applyLighting(const Fragment& fragment,
@@ -7,9 +7,75 @@
  * permission is granted.
  ****************************************************/
 
+#include <cstring>
+#include <fstream>
 #include "defs.h"
 #include "utilities.h"
 #include "framebuffer.h"
+#include "camera.h"
+#include "framecapture.h"
+
+static_assert(sizeof(color) == 3 * sizeof(double), "color must be 3 packed doubles");
+
+#ifdef AVX2_PATHS
+/**
+ * @fn	static int colorsToBytesAVX2(const color *C, GLubyte *dest, int n)
+ * @brief	Converts colors to bytes as colorsToBytes does, 4 colors at a time. Since
+ *			color is 3 packed doubles, the doubles map one-to-one onto the bytes, so
+ *			4 colors are 12 doubles, i.e., three AVX registers.
+ * @param 		  	C   	The colors.
+ * @param [in,out]	dest	Destination - 3 * n bytes.
+ * @param 		  	n   	Number of colors.
+ * @return	The number of colors converted: n rounded down to a multiple of 4.
+ */
+
+AVX2_TARGET static int colorsToBytesAVX2(const color* C, GLubyte* dest, int n) {
+	int i = 0;
+	const __m256d ZERO = _mm256_setzero_pd();
+	const __m256d ONE = _mm256_set1_pd(1.0);
+	const __m256d SCALE = _mm256_set1_pd(255.0);
+	const double* src = &C[0].x;
+	for (; i + 4 <= n; i += 4) {
+		const double* p = src + BYTES_PER_PIXEL * i;
+		__m256d d0 = _mm256_min_pd(_mm256_max_pd(_mm256_loadu_pd(p), ZERO), ONE);
+		__m256d d1 = _mm256_min_pd(_mm256_max_pd(_mm256_loadu_pd(p + 4), ZERO), ONE);
+		__m256d d2 = _mm256_min_pd(_mm256_max_pd(_mm256_loadu_pd(p + 8), ZERO), ONE);
+		__m128i i0 = _mm256_cvttpd_epi32(_mm256_mul_pd(d0, SCALE));
+		__m128i i1 = _mm256_cvttpd_epi32(_mm256_mul_pd(d1, SCALE));
+		__m128i i2 = _mm256_cvttpd_epi32(_mm256_mul_pd(d2, SCALE));
+		__m128i bytes = _mm_packus_epi16(_mm_packus_epi32(i0, i1), _mm_packus_epi32(i2, i2));
+		GLubyte packed[16];
+		_mm_storeu_si128((__m128i*)packed, bytes);
+		std::memcpy(dest + BYTES_PER_PIXEL * i, packed, 4 * BYTES_PER_PIXEL);
+	}
+	return i;
+}
+#endif
+
+/**
+ * @fn	static void colorsToBytes(const color *C, GLubyte *dest, int n)
+ * @brief	Clamps, scales and packs n colors into RGB bytes. Produces exactly the
+ *			same bytes as setColor. Uses colorsToBytesAVX2 when the CPU has AVX2.
+ * @param 		  	C   	The colors.
+ * @param [in,out]	dest	Destination - 3 * n bytes.
+ * @param 		  	n   	Number of colors.
+ */
+
+static void colorsToBytes(const color* C, GLubyte* dest, int n) {
+	int i = 0;
+#ifdef AVX2_PATHS
+	if (cpuHasAVX2()) {
+		i = colorsToBytesAVX2(C, dest, n);
+	}
+#endif
+	for (; i < n; i++) {
+		color clampedColor = glm::clamp(C[i], 0.0, 1.0);
+		GLubyte* d = dest + BYTES_PER_PIXEL * i;
+		d[0] = (GLubyte)(clampedColor.r * 255);
+		d[1] = (GLubyte)(clampedColor.g * 255);
+		d[2] = (GLubyte)(clampedColor.b * 255);
+	}
+}
 
  /**
   * @fn	FrameBuffer::FrameBuffer(const int width, const int height)
@@ -18,7 +84,8 @@
   * @param	height	The height.
   */
 
-FrameBuffer::FrameBuffer(const int width, const int height) {
+FrameBuffer::FrameBuffer(const int width, const int height)
+	: colorBuffer(nullptr), depthBuffer(nullptr), captureSink(nullptr) {
 	setFrameBufferSize(width, height);
 }
 
@@ -46,13 +113,16 @@ void FrameBuffer::setFrameBufferSize(int width, int height) {
     height *= 2;
 #endif
 
+	if (colorBuffer != nullptr && width == this->width && height == this->height) {
+		return;		// no need to reallocate
+	}
 	this->width = width;
 	this->height = height;
 	int area = width * height;
 	delete[] colorBuffer;
 	delete[] depthBuffer;
 	colorBuffer = new GLubyte[area * BYTES_PER_PIXEL];
-	depthBuffer = new double[area];
+	depthBuffer = new PixelReal[area];
 }
 
 /**
@@ -100,8 +170,30 @@ void FrameBuffer::clearColorBuffer() {
 void FrameBuffer::clearDepthBuffer() {
 	int area = width * height;
 	const int SZ = area;
-	std::fill(depthBuffer, depthBuffer + SZ, 1.0);
+	std::fill(depthBuffer, depthBuffer + SZ, (PixelReal)1.0);
+}
+/**
+ * @fn	bool FrameBuffer::writePPM(const string &fileName) const
+ * @brief	Writes the color buffer to a binary (P6) PPM file. The color buffer is
+ *			stored bottom row first, so rows are written in reverse.
+ * @param	fileName	Name of the file.
+ * @return	False if the file could not be opened.
+ */
+
+bool FrameBuffer::writePPM(const string& fileName) const {
+	std::ofstream out(fileName, std::ios::binary);
+	if (!out.is_open()) {
+		cout << "Error: Cannot open file " << fileName << endl;
+		return false;
+	}
+	out << "P6\n" << width << " " << height << "\n255\n";
+	const int ROW_BYTES = width * BYTES_PER_PIXEL;
+	for (int row = height - 1; row >= 0; row--) {
+		out.write((const char*)colorBuffer + row * ROW_BYTES, ROW_BYTES);
+	}
+	return true;
 }
+
 /**
  * @fn	void FrameBuffer::showColorBuffer() const
  * @brief	Shows the contents of the color buffer to screen.
@@ -113,6 +205,50 @@ void FrameBuffer::showColorBuffer() const {
 	glFlush();
 }
 
+/**
+ * @fn	void FrameBuffer::captureFrame() const
+ * @brief	Sends the current contents of the color buffer to the capture sink, if one
+ *			has been set. Call once per finished frame. Returns as soon as the frame
+ *			has been copied; the sink writes it to disk on its own thread.
+ */
+
+void FrameBuffer::captureFrame() const {
+	if (captureSink != nullptr) {
+		captureSink->submit(colorBuffer, width, height);
+	}
+}
+
+/**
+ * @fn	void FrameBuffer::copyScaled(const FrameBuffer &source)
+ * @brief	Fills this color buffer with a nearest-neighbor rescaling of source's
+ *			color buffer. Used to show an image rendered at reduced resolution at the
+ *			full size of the window. Rows that map to the same source row are copied
+ *			from the previous destination row.
+ * @param	source	The framebuffer to copy from. Any size.
+ */
+
+void FrameBuffer::copyScaled(const FrameBuffer& source) {
+	const int ROW_BYTES = BYTES_PER_PIXEL * width;
+	vector<int> srcOffset(width);
+	for (int x = 0; x < width; x++) {
+		srcOffset[x] = BYTES_PER_PIXEL * (x * source.width / width);
+	}
+	int prevSrcY = -1;
+	for (int y = 0; y < height; y++) {
+		int srcY = y * source.height / height;
+		GLubyte* dst = colorBuffer + y * ROW_BYTES;
+		if (srcY == prevSrcY) {
+			std::memcpy(dst, dst - ROW_BYTES, ROW_BYTES);
+			continue;
+		}
+		const GLubyte* src = source.colorBuffer + srcY * BYTES_PER_PIXEL * source.width;
+		for (int x = 0; x < width; x++) {
+			std::memcpy(dst + BYTES_PER_PIXEL * x, src + srcOffset[x], BYTES_PER_PIXEL);
+		}
+		prevSrcY = srcY;
+	}
+}
+
 /**
  * @fn	void FrameBuffer::getClearColor()
  * @brief	Returns the clear color
@@ -144,6 +280,84 @@ void FrameBuffer::setColor(int x, int y, const color& rgb) {
 	std::memcpy(colorBuffer + BYTES_PER_PIXEL * (x + y * width), c, BYTES_PER_PIXEL);
 }
 
+/**
+ * @fn	bool FrameBuffer::clipSpan(int &x, int y, int &n, int &first) const
+ * @brief	Clips the horizontal span of n pixels starting at (x, y) to the window.
+ * @param [in,out]	x		The first x coordinate; adjusted to the first visible pixel.
+ * @param 		  	y		The y coordinate.
+ * @param [in,out]	n		The span length; adjusted to the number of visible pixels.
+ * @param [out]		first	Index (into the original span) of the first visible pixel.
+ * @return	True iff some part of the span is visible.
+ */
+
+bool FrameBuffer::clipSpan(int& x, int y, int& n, int& first) const {
+	if (y < 0 || y >= height) {
+		return false;
+	}
+	int lo = std::max(x, 0);
+	int hi = std::min(x + n, width);
+	first = lo - x;
+	x = lo;
+	n = hi - lo;
+	return n > 0;
+}
+
+/**
+ * @fn	void FrameBuffer::setColorSpan(int x, int y, int n, const color *C)
+ * @brief	Sets the colors of n consecutive pixels, starting at (x, y) and moving right.
+ *			The span is clipped against the window once, rather than per pixel.
+ * @param	x	The x coordinate of the first pixel.
+ * @param	y	The y coordinate.
+ * @param	n	Number of pixels.
+ * @param	C	The n colors.
+ */
+
+void FrameBuffer::setColorSpan(int x, int y, int n, const color* C) {
+	int first;
+	if (clipSpan(x, y, n, first)) {
+		colorsToBytes(C + first, colorBuffer + BYTES_PER_PIXEL * (x + y * width), n);
+	}
+}
+
+/**
+ * @fn	void FrameBuffer::setColorTile(const BoundingBoxi &tile, const color *C)
+ * @brief	Sets the colors of a rectangular block of pixels, one clipped span per row.
+ * @param	tile	The block. Its lower left corner is (lx, ly).
+ * @param	C   	tile.width * tile.height colors, stored row by row beginning
+ *					with the bottom row.
+ */
+
+void FrameBuffer::setColorTile(const BoundingBoxi& tile, const color* C) {
+	for (int row = 0; row < tile.height; row++) {
+		setColorSpan(tile.lx, tile.ly + row, tile.width, C + row * tile.width);
+	}
+}
+
+/**
+ * @fn	void FrameBuffer::setColorSpan(int x, int y, int n, const color &C)
+ * @brief	Sets n consecutive pixels, starting at (x, y) and moving right, to one
+ *			color. The color is converted to bytes once.
+ * @param	x	The x coordinate of the first pixel.
+ * @param	y	The y coordinate.
+ * @param	n	Number of pixels.
+ * @param	C	The color.
+ */
+
+void FrameBuffer::setColorSpan(int x, int y, int n, const color& C) {
+	int first;
+	if (!clipSpan(x, y, n, first)) {
+		return;
+	}
+	GLubyte c[BYTES_PER_PIXEL];
+	colorsToBytes(&C, c, 1);
+	GLubyte* dest = colorBuffer + BYTES_PER_PIXEL * (x + y * width);
+	for (int i = 0; i < n; i++, dest += BYTES_PER_PIXEL) {
+		dest[0] = c[0];
+		dest[1] = c[1];
+		dest[2] = c[2];
+	}
+}
+
 /**
  * @fn	color FrameBuffer::getColor(int x, int y) const
  * @brief	Gets the color at (x, y)
@@ -195,7 +409,7 @@ void FrameBuffer::setDepth(double x, double y, double depth) {
 
 void FrameBuffer::setDepth(int x, int y, double depth) {
 	if (checkInWindow(x, y)) {
-		depthBuffer[y * width + x] = depth;
+		depthBuffer[y * width + x] = (PixelReal)depth;
 	}
 }
 
@@ -254,103 +468,115 @@ void FrameBuffer::setPixel(int x, int y, const color& C, double depth) {
 	setColor(x, y, C);
 }
 
-double computeAq(const QuadricParameters& qParams, const Ray& ray) {
-	const double& A = qParams.A;
-	const double& B = qParams.B;
-	const double& C = qParams.C;
-	const double& J = qParams.J;
-	const double twoA = 2.0 * A;
-	const double twoB = 2.0 * B;
-	const double twoC = 2.0 * C;
-	dvec3 Ro = ray.origin;
-	const dvec3& Rd = ray.dir;
-
-	return A * glm::pow(Rd.x, 2) +
-		B * glm::pow(Rd.y, 2) +
-		C * glm::pow(Rd.z, 2);
-}
-
-double computeBq(const QuadricParameters& qParams, const Ray& ray) {
-	const double& A = qParams.A;
-	const double& B = qParams.B;
-	const double& C = qParams.C;
-	const double& J = qParams.J;
-	const double twoA = 2.0 * A;
-	const double twoB = 2.0 * B;
-	const double twoC = 2.0 * C;
-	dvec3 Ro = ray.origin;
-	const dvec3& Rd = ray.dir;
-
-	return twoA * Ro.x * Rd.x +
-		twoB * Ro.y * Rd.y +
-		twoC * Ro.z * Rd.z;
-}
-
-double computeCq(const QuadricParameters& qParams, const Ray& ray) {
-	const double& A = qParams.A;
-	const double& B = qParams.B;
-	const double& C = qParams.C;
-	const double& J = qParams.J;
-	const double twoA = 2.0 * A;
-	const double twoB = 2.0 * B;
-	const double twoC = 2.0 * C;
-	dvec3 Ro = ray.origin;
-	const dvec3& Rd = ray.dir;
-
-	return A * glm::pow(Ro.x, 2.0) +
-		B * glm::pow(Ro.y, 2.0) +
-		C * glm::pow(Ro.z, 2.0) +
-		J;
-}
-
-double solve(double A, double B, double C) {
-	double D = B * B - 4 * A * C;
-	if (D < 0) return -1.0;
-	return (-B + std::sqrt(D)) / (2.0 * A);
+/**
+ * @fn	void FrameBuffer::setPixelSpan(int x, int y, int n, const color *C, const double *depths)
+ * @brief	Sets the colors and depths of n consecutive pixels, starting at (x, y).
+ *			The span is clipped against the window once, rather than per pixel.
+ * @param	x	  	The x coordinate of the first pixel.
+ * @param	y	  	The y coordinate.
+ * @param	n	  	Number of pixels.
+ * @param	C	  	The n colors.
+ * @param	depths	The n depths. They are rounded to PixelReal when stored.
+ */
+
+void FrameBuffer::setPixelSpan(int x, int y, int n, const color* C, const double* depths) {
+	int first;
+	if (clipSpan(x, y, n, first)) {
+		std::copy(depths + first, depths + first + n, depthBuffer + (x + y * width));
+		colorsToBytes(C + first, colorBuffer + BYTES_PER_PIXEL * (x + y * width), n);
+	}
+}
+
+/**
+ * @fn	static void axisDot(FrameBuffer &fb, const BoundingBoxi &viewport, const dvec2 &pt,
+ *								int W, const color &C)
+ * @brief	Colors every other pixel within W pixels of pt, giving the axes
+ *			their "see-through" appearance. pt is relative to the viewport, and
+ *			pixels outside the viewport are left alone.
+ */
+
+static void axisDot(FrameBuffer& fb, const BoundingBoxi& viewport, const dvec2& pt,
+	int W, const color& C) {
+	int x = (int)std::floor(pt.x);
+	int y = (int)std::floor(pt.y);
+	for (int row = std::max(y - W, 0); row <= std::min(y + W, viewport.height - 1); row++) {
+		for (int col = std::max(x - W, 0); col <= std::min(x + W, viewport.width - 1); col++) {
+			if (col % 2 == 0 && row % 2 == 0) {
+				fb.setColor(viewport.lx + col, viewport.ly + row, C);
+			}
+		}
+	}
+}
+
+/**
+ * @fn	static void drawAxisSegment(FrameBuffer &fb, const RaytracingCamera &camera,
+ *										const BoundingBoxi &viewport,
+ *										const dvec3 &A, const dvec3 &B, double thickness,
+ *										const color &C)
+ * @brief	Draws the (already near-clipped) segment AB by recursively subdividing it
+ *			until each piece covers at most one pixel on screen.
+ */
+
+static void drawAxisSegment(FrameBuffer& fb, const RaytracingCamera& camera,
+	const BoundingBoxi& viewport,
+	const dvec3& A, const dvec3& B, double thickness, const color& C) {
+	dvec2 a, b;
+	camera.projectToWindow(A, a);
+	camera.projectToWindow(B, b);
+
+	const double W = viewport.width;
+	const double H = viewport.height;
+	if ((a.x < 0 && b.x < 0) || (a.x >= W && b.x >= W) ||
+		(a.y < 0 && b.y < 0) || (a.y >= H && b.y >= H)) {
+		return;
+	}
+
+	if (glm::distance(a, b) <= 1.0) {
+		dvec2 edge;
+		camera.projectToWindow(A + thickness * camera.getFrame().u, edge);
+		const int MAX_RADIUS = 8;		// keeps axes passing near the eye cheap
+		int radius = (int)std::ceil(glm::distance(a, edge));
+		axisDot(fb, viewport, a, std::min(radius, MAX_RADIUS), C);
+	} else {
+		dvec3 M = (A + B) / 2.0;
+		drawAxisSegment(fb, camera, viewport, A, M, thickness, C);
+		drawAxisSegment(fb, camera, viewport, M, B, thickness, C);
+	}
 }
 
 /**
- * @fn	void FrameBuffer::showAxes(int x, int y, const Ray &ray, double thickness)
- * @brief	Inserts a R, G, or B pixel if the ray hits the X, Y, or Z axis.
- * @param	x   The x coordinate in the framebuffer
- * @param	y   The y coordinate in the framebuffer
- * @param	ray The viewing ray
- * @param	thickness how wide the axes should appear
+ * @fn	void FrameBuffer::showAxes(const RaytracingCamera &camera, double thickness,
+ *									const BoundingBoxi &viewport)
+ * @brief	Overlays the positive X, Y, and Z axes (in R, G, and B) on top of a ray
+ *			traced image. The three axis segments are projected through the camera
+ *			once per frame, rather than being intersected with every pixel's ray.
+ * @param	camera   	The camera used to render the image.
+ * @param	thickness	How wide the axes should appear, in world units.
+ * @param	viewport 	The part of the framebuffer the camera rendered into.
  */
 
-void FrameBuffer::showAxes(int x, int y, const Ray& ray, double thickness) {
-	color currColor = getColor(x, y);
-	static const QuadricParameters X = QuadricParameters::cylinderXQParams(thickness);
-	static const QuadricParameters Y = QuadricParameters::cylinderYQParams(thickness);
-	static const QuadricParameters Z = QuadricParameters::cylinderZQParams(thickness);
-	const double AqX = computeAq(X, ray);
-	const double BqX = computeBq(X, ray);
-	const double CqX = computeCq(X, ray);
-	const double AqY = computeAq(Y, ray);
-	const double BqY = computeBq(Y, ray);
-	const double CqY = computeCq(Y, ray);
-	const double AqZ = computeAq(Z, ray);
-	const double BqZ = computeBq(Z, ray);
-	const double CqZ = computeCq(Z, ray);
-	const double tX = solve(AqX, BqX, CqX);
-	const double tY = solve(AqY, BqY, CqY);
-	const double tZ = solve(AqZ, BqZ, CqZ);
-	const dvec3 interceptWithXTube = ray.getPoint(tX);
-	const dvec3 interceptWithYTube = ray.getPoint(tY);
-	const dvec3 interceptWithZTube = ray.getPoint(tZ);
-	const int W = 2;
-	bool inXTube = glm::sqrt(glm::pow(ray.origin.y, 2.0) + glm::pow(ray.origin.z, 2.0)) <= thickness;
-	bool inYTube = glm::sqrt(glm::pow(ray.origin.x, 2.0) + glm::pow(ray.origin.z, 2.0)) <= thickness;
-	bool inZTube = glm::sqrt(glm::pow(ray.origin.x, 2.0) + glm::pow(ray.origin.y, 2.0)) <= thickness;
-
-	if (x % W == 0 && y % W == 0) {		// color every other pixel
-		if (tX >= 0 && interceptWithXTube.x >= 0 && !inXTube) {
-			setColor(x, y, red);
-		} else if (tY > 0 && interceptWithYTube.y >= 0 && !inYTube) {
-			setColor(x, y, green);
-		} else if (tZ > 0 && interceptWithZTube.z >= 0 && !inZTube) {
-			setColor(x, y, blue);
+void FrameBuffer::showAxes(const RaytracingCamera& camera, double thickness,
+	const BoundingBoxi& viewport) {
+	const double LEN = 1000.0;
+	const static dvec3 AXES[] = { X_AXIS, Y_AXIS, Z_AXIS };
+	const static color C[] = { red, green, blue };
+	const Frame frame = camera.getFrame();
+
+	for (int i = 0; i < 3; i++) {
+		dvec3 A = ORIGIN3D;
+		dvec3 B = LEN * AXES[i];
+
+		// Clip the segment so that it lies entirely in front of the camera.
+		double zA = frame.globalCoordToFrameCoords(A).z;
+		double zB = frame.globalCoordToFrameCoords(B).z;
+		if (zA > -EPSILON && zB > -EPSILON) {
+			continue;
+		} else if (zA > -EPSILON) {
+			A = A + ((zA + EPSILON) / (zA - zB)) * (B - A);
+		} else if (zB > -EPSILON) {
+			B = A + ((zA + EPSILON) / (zA - zB)) * (B - A);
 		}
+		drawAxisSegment(*this, camera, viewport, A, B, thickness, C[i]);
 	}
 }
 
@@ -19,6 +19,9 @@
 
 const int BYTES_PER_PIXEL = 3;			//!< RGB requires 3 bytes.
 
+struct RaytracingCamera;
+struct FrameCapture;
+
 /**
  * @struct	FrameBuffer
  * @brief	Represents a framebuffer. Two identically sized 2D arrays. The color
@@ -32,6 +35,9 @@ struct FrameBuffer {
 	void setFrameBufferSize(int width, int height);
 	void setClearColor(const color& clearColor);
 	void setColor(int x, int y, const color& C);
+	void setColorSpan(int x, int y, int n, const color* C);
+	void setColorSpan(int x, int y, int n, const color& C);
+	void setColorTile(const BoundingBoxi& tile, const color* C);
 	color getClearColor();
 	color getColor(int x, int y) const;
 
@@ -39,6 +45,10 @@ struct FrameBuffer {
 	void clearColorBuffer();
 	void clearDepthBuffer();
 	void showColorBuffer() const;
+	bool writePPM(const string& fileName) const;
+	void setCaptureSink(FrameCapture* sink) { captureSink = sink; }
+	void captureFrame() const;
+	void copyScaled(const FrameBuffer& source);
 	int getWindowWidth() const { return width; }
 	int getWindowHeight() const { return height; }
 
@@ -47,16 +57,20 @@ struct FrameBuffer {
 	double getDepth(int x, int y) const;
 	double getDepth(double x, double y) const;
 
-	void showAxes(int x, int y, const Ray& ray, double thickness);
+	void showAxes(const RaytracingCamera& camera, double thickness,
+		const BoundingBoxi& viewport);
 	void showAxes(const dmat4& VM, const dmat4& PM, const dmat4& VPM,
 		const BoundingBoxi& viewport);
 	void setPixel(int x, int y, const color& C, double depth);
+	void setPixelSpan(int x, int y, int n, const color* C, const double* depths);
 protected:
 	bool checkInWindow(int x, int y) const;
+	bool clipSpan(int& x, int y, int& n, int& first) const;
 	int width;								//!< width of framebuffer
 	int height;								//!< height of framebuffer
 	GLubyte clearColorUB[BYTES_PER_PIXEL];	//!< Clear color, as unsigned bytes
 	color clearColor;						//!< Clear color
 	GLubyte* colorBuffer;					//!< 2D array for holding colors
-	double* depthBuffer;					//!< 2D array for holding depths
+	PixelReal* depthBuffer;						//!< 2D array for holding depths
+	FrameCapture* captureSink;				//!< Where captureFrame sends frames, if anywhere
 };
\ No newline at end of file
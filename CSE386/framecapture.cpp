@@ -0,0 +1,222 @@
+/****************************************************
+ * 2016-2025 Eric Bachmann and Mike Zmuda
+ * All Rights Reserved.
+ * NOTICE:
+ * Dissemination of this information or reproduction
+ * of this material is prohibited unless prior written
+ * permission is granted.
+ ****************************************************/
+
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include "framecapture.h"
+#include "framebuffer.h"
+
+/**
+ * @fn	FrameCapture::FrameCapture(const string &baseName, CaptureFormat format,
+ *									int framesPerSecond, int ringSize)
+ * @brief	Constructs a frame capture and starts its writer thread.
+ * @param	baseName	   	For NUMBERED_PPM, the prefix of each file (e.g., "frame"
+ *							produces frame_0000.ppm, frame_0001.ppm, ...). For Y4M, the
+ *							name of the single output file.
+ * @param	format		   	The output format.
+ * @param	framesPerSecond	Frame rate stored in the Y4M header.
+ * @param	ringSize	   	Number of frames that can be waiting to be written.
+ */
+
+FrameCapture::FrameCapture(const string& baseName, CaptureFormat format,
+	int framesPerSecond, int ringSize)
+	: baseName(baseName), format(format), fps(framesPerSecond),
+	ring(std::max(ringSize, 1)), head(0), count(0),
+	framesSubmitted(0), framesWritten(0), framesDropped(0), done(false),
+	streamWidth(0), streamHeight(0) {
+	if (format == CaptureFormat::Y4M) {
+		y4mFile.open(baseName, std::ios::binary);
+		if (!y4mFile.is_open()) {
+			cout << "Error: Cannot open file " << baseName << endl;
+		}
+	}
+	writer = std::thread(&FrameCapture::writerLoop, this);
+}
+
+/**
+ * @fn	FrameCapture::~FrameCapture()
+ * @brief	Destructor. Writes any frames still in the ring.
+ */
+
+FrameCapture::~FrameCapture() {
+	finish();
+}
+
+/**
+ * @fn	bool FrameCapture::submit(const GLubyte *rgb, int width, int height)
+ * @brief	Queues a frame for writing. Only a copy into a preallocated slot happens
+ *			on the calling thread. Frames must be submitted from a single thread.
+ * @param	rgb   	The frame, as stored in a FrameBuffer's color buffer.
+ * @param	width 	The width of the frame.
+ * @param	height	The height of the frame.
+ * @return	False if the frame was dropped.
+ */
+
+bool FrameCapture::submit(const GLubyte* rgb, int width, int height) {
+	std::unique_lock<std::mutex> lock(mtx);
+	if (done || count == (int)ring.size()) {
+		framesDropped++;
+		return false;
+	}
+	Slot& slot = ring[(head + count) % ring.size()];
+	lock.unlock();
+
+	// The writer never touches slots beyond count, so the copy can happen unlocked.
+	const size_t SZ = (size_t)width * height * BYTES_PER_PIXEL;
+	if (slot.pixels.size() != SZ) {
+		slot.pixels.resize(SZ);		// only when the frame size changes
+	}
+	std::memcpy(slot.pixels.data(), rgb, SZ);
+	slot.width = width;
+	slot.height = height;
+
+	lock.lock();
+	slot.frameNumber = framesSubmitted++;
+	count++;
+	lock.unlock();
+	slotFilled.notify_one();
+	return true;
+}
+
+/**
+ * @fn	void FrameCapture::finish()
+ * @brief	Stops accepting frames, waits for the queued frames to be written and
+ *			closes the output.
+ */
+
+void FrameCapture::finish() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (done) {
+			return;
+		}
+		done = true;
+	}
+	slotFilled.notify_one();
+	writer.join();
+	if (y4mFile.is_open()) {
+		y4mFile.close();
+	}
+	cout << "Captured " << framesWritten << " frames";
+	if (framesDropped > 0) {
+		cout << " (" << framesDropped << " dropped)";
+	}
+	cout << endl;
+}
+
+/**
+ * @fn	void FrameCapture::writerLoop()
+ * @brief	Body of the writer thread. Writes frames in the order they were submitted.
+ */
+
+void FrameCapture::writerLoop() {
+	while (true) {
+		std::unique_lock<std::mutex> lock(mtx);
+		slotFilled.wait(lock, [this] { return count > 0 || done; });
+		if (count == 0) {
+			return;		// done, and nothing left to write
+		}
+		const Slot& slot = ring[head];
+		lock.unlock();
+
+		if (writeFrame(slot)) {
+			framesWritten++;
+		} else {
+			framesDropped++;
+		}
+
+		lock.lock();
+		head = (head + 1) % ring.size();
+		count--;
+	}
+}
+
+/**
+ * @fn	void FrameCapture::writeFrame(const Slot &slot)
+ * @brief	Writes a single frame in the selected format.
+ * @param	slot	The frame.
+ * @return	False if the frame could not be written.
+ */
+
+bool FrameCapture::writeFrame(const Slot& slot) {
+	if (format == CaptureFormat::NUMBERED_PPM) {
+		return writePPM(slot);
+	} else {
+		return writeY4M(slot);
+	}
+}
+
+/**
+ * @fn	void FrameCapture::writePPM(const Slot &slot)
+ * @brief	Writes a frame as a binary (P6) PPM file. The color buffer is stored
+ *			bottom row first, so rows are written in reverse.
+ * @param	slot	The frame.
+ * @return	False if the file could not be opened.
+ */
+
+bool FrameCapture::writePPM(const Slot& slot) {
+	std::ostringstream name;
+	name << baseName << "_" << std::setw(4) << std::setfill('0') << slot.frameNumber << ".ppm";
+	std::ofstream out(name.str(), std::ios::binary);
+	if (!out.is_open()) {
+		cout << "Error: Cannot open file " << name.str() << endl;
+		return false;
+	}
+	out << "P6\n" << slot.width << " " << slot.height << "\n255\n";
+	const int ROW_BYTES = slot.width * BYTES_PER_PIXEL;
+	for (int row = slot.height - 1; row >= 0; row--) {
+		out.write((const char*)slot.pixels.data() + row * ROW_BYTES, ROW_BYTES);
+	}
+	return true;
+}
+
+/**
+ * @fn	void FrameCapture::writeY4M(const Slot &slot)
+ * @brief	Appends a frame to the Y4M stream, converting it to 4:4:4 YCbCr (BT.601).
+ *			The stream header is written with the first frame; frames with a different
+ *			size are skipped since Y4M cannot change size mid-stream.
+ * @param	slot	The frame.
+ * @return	False if the frame was skipped or the file is not open.
+ */
+
+bool FrameCapture::writeY4M(const Slot& slot) {
+	if (!y4mFile.is_open()) {
+		return false;
+	}
+	if (streamWidth == 0) {
+		streamWidth = slot.width;
+		streamHeight = slot.height;
+		y4mFile << "YUV4MPEG2 W" << streamWidth << " H" << streamHeight
+			<< " F" << fps << ":1 Ip A1:1 C444\n";
+	} else if (slot.width != streamWidth || slot.height != streamHeight) {
+		cout << "Frame " << slot.frameNumber << " skipped: size changed." << endl;
+		return false;
+	}
+
+	const int W = slot.width;
+	const int H = slot.height;
+	planes.resize((size_t)W * H * BYTES_PER_PIXEL);
+	GLubyte* Yp = planes.data();
+	GLubyte* Cb = Yp + W * H;
+	GLubyte* Cr = Cb + W * H;
+	for (int row = 0; row < H; row++) {
+		const GLubyte* src = slot.pixels.data() + (H - 1 - row) * W * BYTES_PER_PIXEL;
+		for (int col = 0; col < W; col++, src += BYTES_PER_PIXEL) {
+			int r = src[0], g = src[1], b = src[2];
+			int i = row * W + col;
+			Yp[i] = (GLubyte)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+			Cb[i] = (GLubyte)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+			Cr[i] = (GLubyte)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+		}
+	}
+	y4mFile << "FRAME\n";
+	y4mFile.write((const char*)planes.data(), planes.size());
+	return true;
+}
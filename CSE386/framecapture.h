@@ -0,0 +1,70 @@
+/****************************************************
+ * 2016-2025 Eric Bachmann and Mike Zmuda
+ * All Rights Reserved.
+ * NOTICE:
+ * Dissemination of this information or reproduction
+ * of this material is prohibited unless prior written
+ * permission is granted.
+ ****************************************************/
+
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include "defs.h"
+
+/**
+ * @enum	CaptureFormat
+ * @brief	The different file formats a FrameCapture can produce.
+ */
+
+enum class CaptureFormat { NUMBERED_PPM, Y4M };
+
+/**
+ * @struct	FrameCapture
+ * @brief	Records a sequence of frames to disk. Frames are copied into a ring of
+ *			preallocated buffers and a background thread writes them out, so that
+ *			capturing does not stall the render loop. If the writer falls a whole
+ *			ring behind, new frames are dropped (and counted) rather than waited on.
+ *			Frames that cannot be written are counted as dropped too.
+ */
+
+struct FrameCapture {
+	FrameCapture(const string& baseName, CaptureFormat format,
+		int framesPerSecond = 30, int ringSize = 8);
+	~FrameCapture();
+	bool submit(const GLubyte* rgb, int width, int height);
+	void finish();
+	int getFramesWritten() const { return framesWritten; }
+	int getFramesDropped() const { return framesDropped; }
+protected:
+	struct Slot {
+		vector<GLubyte> pixels;		//!< Bottom-to-top RGB rows, as in the color buffer
+		int width, height;			//!< Size of the frame held in this slot
+		int frameNumber;			//!< Sequence number of the frame
+	};
+	string baseName;				//!< File name prefix (PPM) or file name (Y4M)
+	CaptureFormat format;			//!< Output format
+	int fps;						//!< Frame rate recorded in Y4M header
+	vector<Slot> ring;				//!< Preallocated frame buffers
+	int head;						//!< Next slot to write into
+	int count;						//!< Number of filled slots waiting to be written
+	int framesSubmitted;			//!< Frames accepted so far
+	std::atomic<int> framesWritten;	//!< Frames written to disk so far
+	std::atomic<int> framesDropped;	//!< Frames dropped, or that could not be written
+	bool done;						//!< True once finish has been called
+	int streamWidth, streamHeight;	//!< Frame size fixed by the Y4M header
+	std::ofstream y4mFile;			//!< Output stream, for Y4M captures
+	vector<GLubyte> planes;			//!< Y, Cb and Cr planes, used by the writer thread
+	std::mutex mtx;
+	std::condition_variable slotFilled;
+	std::thread writer;
+
+	void writerLoop();
+	bool writeFrame(const Slot& slot);
+	bool writePPM(const Slot& slot);
+	bool writeY4M(const Slot& slot);
+};
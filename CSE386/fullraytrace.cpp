@@ -19,6 +19,8 @@
 #include "image.h"
 #include "camera.h"
 #include "rasterization.h"
+#include "framecapture.h"
+#include "dynamicresolution.h"
 
 using namespace std::chrono;
 
@@ -60,6 +62,9 @@ SpotLightPtr spotLight = (SpotLightPtr)lights[1];
 
 
 FrameBuffer frameBuffer(W, H);
+FrameBuffer lowResBuffer(W, H);
+FrameCapture* capture = nullptr;
+DynamicResolution dynamicRes(33.0);
 
 RayTracer rayTrace(paleGreen);
 IScene scene;
@@ -121,17 +126,53 @@ void render(GLFWwindow* window) {
 	int bottom = 0;
 	int top = frameBuffer.getWindowHeight() - 1;
 	double N = 6.0;
-	scene.camera = new PerspectiveCamera(cameraPos, cameraFocus, cameraUp, cameraFOV, width, height);
-	cout << clearPlane->a << endl;
-	rayTrace.raytraceScene(frameBuffer, numReflections, scene, antiAliasing);
+	if (multiViewOn) {
+		// Top, front, side and perspective views, one per quadrant.
+		const int halfW = width / 2;
+		const int halfH = height / 2;
+		const double ORTHO_SCALE = 0.1;
+		OrthographicCamera topView(dvec3(0, 20, 0), ORIGIN3D, -Z_AXIS, halfW, halfH, ORTHO_SCALE);
+		OrthographicCamera front(dvec3(0, 0, 20), ORIGIN3D, Y_AXIS, halfW, halfH, ORTHO_SCALE);
+		OrthographicCamera side(dvec3(20, 0, 0), ORIGIN3D, Y_AXIS, halfW, halfH, ORTHO_SCALE);
+		PerspectiveCamera perspective(cameraPos, cameraFocus, cameraUp, cameraFOV, halfW, halfH);
+		vector<RaytracingCamera*> cameras = { &topView, &front, &side, &perspective };
+		vector<BoundingBoxi> viewports = { BoundingBoxi(0, halfW, halfH, halfH),
+											BoundingBoxi(halfW, halfW, halfH, halfH),
+											BoundingBoxi(0, halfW, 0, halfH),
+											BoundingBoxi(halfW, halfW, 0, halfH) };
+		rayTrace.raytraceViews(frameBuffer, numReflections, scene, cameras, viewports, antiAliasing);
+	} else if (dynamicRes.getScale() < 1.0) {
+		// Render at reduced resolution and stretch the result to the whole window.
+		int lowW = dynamicRes.scaled(width);
+		int lowH = dynamicRes.scaled(height);
+		lowResBuffer.setFrameBufferSize(lowW, lowH);
+		lowResBuffer.clearColorBuffer();
+		scene.camera = new PerspectiveCamera(cameraPos, cameraFocus, cameraUp, cameraFOV,
+										lowResBuffer.getWindowWidth(), lowResBuffer.getWindowHeight());
+		rayTrace.raytraceScene(lowResBuffer, numReflections, scene, antiAliasing, false);
+		frameBuffer.copyScaled(lowResBuffer);
+	} else {
+		scene.camera = new PerspectiveCamera(cameraPos, cameraFocus, cameraUp, cameraFOV, width, height);
+		cout << clearPlane->a << endl;
+		rayTrace.raytraceScene(frameBuffer, numReflections, scene, antiAliasing);
+	}
 
 	frameBuffer.showColorBuffer();
+	frameBuffer.captureFrame();
 	milliseconds frameEndTime = duration_cast<milliseconds>(
 		system_clock::now().time_since_epoch()
 	);
 
 	milliseconds totalTime = frameEndTime - frameStartTime;
-	cout << "Render time: " << totalTime.count() << " ms." << endl;
+	cout << "Render time: " << totalTime.count() << " ms";
+	if (dynamicRes.getScale() < 1.0) {
+		cout << " at " << (int)(100 * dynamicRes.getScale()) << "% resolution";
+	}
+	cout << "." << endl;
+	if (isAnimated) {
+		dynamicRes.inputReceived();
+	}
+	dynamicRes.frameFinished((double)totalTime.count());
 	if (isAnimated) {
 		cout << "Transparent plane's z value: " << clearPlane->a.z << endl;
 	}
@@ -149,6 +190,7 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods) {
 		return;
 
 	bool isUpperCase = (mods & GLFW_MOD_SHIFT) != 0;
+	dynamicRes.inputReceived();
 
 	const double INC = 0.5;
 	switch (key) {
@@ -204,6 +246,28 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods) {
 		antiAliasing = 1;
 		cout << "Anti aliasing: " << antiAliasing << endl;
 		break;
+	case GLFW_KEY_G:
+		rayTrace.showAxes = !rayTrace.showAxes;
+		cout << "Axes: " << (rayTrace.showAxes ? "on" : "off") << endl;
+		break;
+	case GLFW_KEY_R:
+		if (capture == nullptr) {
+			capture = new FrameCapture("fullraytrace", CaptureFormat::NUMBERED_PPM);
+		} else {
+			delete capture;
+			capture = nullptr;
+		}
+		frameBuffer.setCaptureSink(capture);
+		cout << "Recording: " << (capture != nullptr ? "on" : "off") << endl;
+		break;
+	case GLFW_KEY_D:
+		dynamicRes.isOn = !dynamicRes.isOn;
+		cout << "Dynamic resolution: " << (dynamicRes.isOn ? "on" : "off") << endl;
+		break;
+	case GLFW_KEY_M:
+		multiViewOn = !multiViewOn;
+		cout << "Multiple views: " << (multiViewOn ? "on" : "off") << endl;
+		break;
 	case GLFW_KEY_P:
 		isAnimated = !isAnimated;
 		cout << "Animation: " << (isAnimated ? "on" : "off") << endl;
@@ -215,6 +279,7 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods) {
 		cout << "Num reflections: " << numReflections << endl;
 		break;
 	case GLFW_KEY_ESCAPE:
+		delete capture;
 		exit(0);
 		break;
 	default:
@@ -224,5 +289,6 @@ void keyboard(GLFWwindow* window, int key, int scancode, int action, int mods) {
 int main(int argc, char* argv[]) {
 	buildScene();
 	initGraphics(W, H, username.c_str(), render, mouseUtility, keyboard, nullptr);
+	delete capture;
 	return 0;
 }
\ No newline at end of file
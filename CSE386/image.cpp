@@ -117,3 +117,60 @@ color Image::getPixelUV(double u, double v) const {
 	int y = glm::clamp((int)(H * v), 0, H - 1);
 	return pixels[y * W + x];
 }
+
+/**
+ * @fn	ImageDifference ImageDifference::compare(const Image &reference, const Image &test)
+ * @brief	Compares two images of the same size, channel by channel. Used to check
+ *			the FLOAT_PIXEL_BUFFERS build against the double build on the same scene.
+ * @param	reference	The reference image.
+ * @param	test	 	The image to measure.
+ * @return	The differences. valid is false if the sizes do not match.
+ */
+
+ImageDifference ImageDifference::compare(const Image& reference, const Image& test) {
+	ImageDifference result = { 0, 0.0, 0.0, 0, false };
+	if (reference.pixels == nullptr || test.pixels == nullptr ||
+		reference.W != test.W || reference.H != test.H) {
+		cout << "Error: Images must be the same size to be compared" << endl;
+		return result;
+	}
+	const int N = reference.W * reference.H;
+	double sum = 0.0, sumSquares = 0.0;
+	for (int i = 0; i < N; i++) {
+		bool differs = false;
+		for (int c = 0; c < 3; c++) {
+			int a = (int)std::round(reference.pixels[i][c] * 255);
+			int b = (int)std::round(test.pixels[i][c] * 255);
+			int e = std::abs(a - b);
+			result.maxError = std::max(result.maxError, e);
+			sum += e;
+			sumSquares += e * e;
+			differs = differs || e != 0;
+		}
+		if (differs) {
+			result.pixelsDiffering++;
+		}
+	}
+	result.meanError = sum / (3.0 * N);
+	double mse = sumSquares / (3.0 * N);
+	result.psnr = mse == 0.0 ? std::numeric_limits<double>::infinity()
+							 : 10.0 * std::log10(255.0 * 255.0 / mse);
+	result.valid = true;
+	return result;
+}
+
+/**
+ * @fn	ostream &operator<<(ostream &os, const ImageDifference &diff)
+ * @brief	Output stream for image differences.
+ * @param 		  	os  	The output stream.
+ * @param 		  	diff	The differences.
+ * @return	The output stream.
+ */
+
+ostream& operator <<(ostream& os, const ImageDifference& diff) {
+	if (!diff.valid) {
+		return os << "[images not comparable]";
+	}
+	return os << "[max error: " << diff.maxError << " mean error: " << diff.meanError
+		<< " PSNR: " << diff.psnr << " dB, pixels differing: " << diff.pixelsDiffering << "]";
+}
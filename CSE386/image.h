@@ -24,3 +24,20 @@ struct Image {
 	~Image() { delete[] pixels; }
 	color getPixelUV(double u, double v) const;
 };
+
+/**
+ * @struct	ImageDifference
+ * @brief	How far one image is from a reference image. Errors are per color
+ *			channel, on a 0 to 255 scale.
+ */
+
+struct ImageDifference {
+	int maxError;			//!< Largest channel difference
+	double meanError;		//!< Mean channel difference
+	double psnr;			//!< Peak signal-to-noise ratio in dB; infinite if identical
+	int pixelsDiffering;	//!< Pixels with at least one channel different
+	bool valid;				//!< False if the images could not be compared
+
+	static ImageDifference compare(const Image& reference, const Image& test);
+	friend ostream& operator <<(ostream& os, const ImageDifference& diff);
+};
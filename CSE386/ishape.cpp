@@ -737,7 +737,7 @@ IConeY::IConeY(const dvec3& pos, double rad, double H)
  */
 
 void IConeY::findClosestIntersection(const Ray& ray, HitRecord& hit) const {
-	static HitRecord hits[2];
+	HitRecord hits[2];
 	int numHits = IQuadricSurface::findIntersections(ray, hits);
 
 	if (numHits == 0) {
@@ -0,0 +1,360 @@
+/****************************************************
+ * 2016-2025 Eric Bachmann and Mike Zmuda
+ * All Rights Reserved.
+ * NOTICE:
+ * Dissemination of this information or reproduction
+ * of this material is prohibited unless prior written
+ * permission is granted.
+ ****************************************************/
+
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <charconv>
+#endif
+#include "objloader.h"
+#include "workerpool.h"
+
+const int32_t ObjCorner::NONE;
+
+const uint8_t GIVEN = 1;		//!< Corner flag bit k: the corner gives attribute k
+const uint8_t RELATIVE = 8;		//!< Corner flag bit k + 3: attribute k is chunk-relative
+
+/**
+ * @struct	ObjChunk
+ * @brief	What one thread parses out of its part of an OBJ file. Relative indices
+ *			are stored relative to the start of the chunk, and flagged, until the
+ *			chunks are joined.
+ */
+
+struct ObjChunk {
+	vector<dvec3> positions;	//!< v records in this chunk
+	vector<dvec2> texCoords;	//!< vt records in this chunk
+	vector<dvec3> normals;		//!< vn records in this chunk
+	vector<ObjCorner> corners;	//!< Three per triangle
+	vector<uint8_t> flags;		//!< Per corner, GIVEN and RELATIVE bits of each attribute
+	int badFaces;				//!< Faces that could not be parsed
+	int badRecords;				//!< v, vt and vn records that could not be parsed
+	ObjChunk() : badFaces(0), badRecords(0) {}
+};
+
+static inline bool isBlank(char c) {
+	return c == ' ' || c == '\t';
+}
+
+static inline const char* skipBlanks(const char* p, const char* end) {
+	while (p < end && isBlank(*p)) {
+		p++;
+	}
+	return p;
+}
+
+static inline const char* skipLine(const char* p, const char* end) {
+	const char* newline = (const char*)std::memchr(p, '\n', end - p);
+	return newline != nullptr ? newline + 1 : end;
+}
+
+/**
+ * @fn	static inline bool parseDouble(const char *&p, const char *end, double &value)
+ * @brief	Parses a number, after any blanks, without leaving the current line.
+ * @param [in,out]	p	 	Where to start; moved past the number on success.
+ * @param 		  	end  	End of the text. The text must be followed by a '\0'.
+ * @param [out]		value	The number.
+ * @return	False if there is no number.
+ */
+
+static inline bool parseDouble(const char*& p, const char* end, double& value) {
+	p = skipBlanks(p, end);
+	if (p < end && *p == '+') {
+		p++;
+	}
+	if (p >= end || *p == '\n' || *p == '\r') {
+		return false;
+	}
+#ifdef __cpp_lib_to_chars
+	std::from_chars_result r = std::from_chars(p, end, value);
+	if (r.ec != std::errc()) {
+		return false;
+	}
+	p = r.ptr;
+#else
+	char* after;
+	value = std::strtod(p, &after);
+	if (after == p) {
+		return false;
+	}
+	p = after;
+#endif
+	return true;
+}
+
+/**
+ * @fn	static inline bool parseInt(const char *&p, const char *end, int &value)
+ * @brief	Parses an optionally signed integer, starting right at p.
+ * @param [in,out]	p	 	Where to start; moved past the integer on success.
+ * @param 		  	end  	End of the text.
+ * @param [out]		value	The integer.
+ * @return	False if there is no integer at p or it does not fit in 32 bits.
+ */
+
+static inline bool parseInt(const char*& p, const char* end, int& value) {
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+	if (p >= end || *p < '0' || *p > '9') {
+		return false;
+	}
+	int64_t v = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		v = 10 * v + (*p - '0');
+		if (v > INT32_MAX) {
+			return false;
+		}
+		p++;
+	}
+	value = (int)(negative ? -v : v);
+	return true;
+}
+
+/**
+ * @fn	static bool parseCorner(const char *&p, const char *end, const int count[3],
+ *								ObjCorner &corner, uint8_t &flags)
+ * @brief	Parses one corner of a face: v, v/vt, v//vn or v/vt/vn. OBJ indices are
+ *			1-based; negative ones count back from the latest record.
+ * @param [in,out]	p	   	Start of the corner; moved past it on success.
+ * @param 		  	end	   	End of the text.
+ * @param 		  	count  	Number of v, vt and vn records so far in this chunk.
+ * @param [out]		corner 	The corner's 0-based indices.
+ * @param [out]		flags  	For each index k, GIVEN << k if it is present and
+ *							RELATIVE << k if it is relative to the chunk.
+ * @return	False if the corner is malformed.
+ */
+
+static bool parseCorner(const char*& p, const char* end, const int count[3],
+	ObjCorner& corner, uint8_t& flags) {
+	int32_t* fields[3] = { &corner.position, &corner.texCoord, &corner.normal };
+	corner.texCoord = corner.normal = ObjCorner::NONE;
+	flags = 0;
+	for (int k = 0; k < 3; k++) {
+		if (k > 0) {
+			if (p >= end || *p != '/') {
+				break;
+			}
+			p++;
+		}
+		int value;
+		if (!parseInt(p, end, value)) {
+			if (k == 0) {
+				return false;
+			}
+			continue;				// empty field, as in v//vn
+		}
+		if (value > 0) {
+			*fields[k] = value - 1;
+		} else if (value < 0) {
+			*fields[k] = count[k] + value;
+			flags |= RELATIVE << k;
+		} else {
+			return false;			// there is no index 0
+		}
+		flags |= GIVEN << k;
+	}
+	return p >= end || isBlank(*p) || *p == '\n' || *p == '\r';
+}
+
+/**
+ * @fn	static void parseChunk(const char *begin, const char *end, ObjChunk &chunk)
+ * @brief	Parses the lines of an OBJ file in [begin, end). Faces are triangulated
+ *			as fans around their first corner. A v, vt or vn record that cannot be
+ *			parsed is counted and stored as zeros, so that the records after it
+ *			keep their indices.
+ * @param 		  	begin	Start of the first line.
+ * @param 		  	end  	End of the last line.
+ * @param [in,out]	chunk	Receives the records and triangles.
+ */
+
+static void parseChunk(const char* begin, const char* end, ObjChunk& chunk) {
+	vector<ObjCorner> face;
+	vector<uint8_t> faceFlags;
+	const char* p = begin;
+	while (p < end) {
+		p = skipBlanks(p, end);
+		if (p + 1 < end && p[0] == 'v' && isBlank(p[1])) {
+			const char* q = p + 2;
+			dvec3 v;
+			if (!(parseDouble(q, end, v.x) && parseDouble(q, end, v.y) && parseDouble(q, end, v.z))) {
+				v = dvec3(0.0, 0.0, 0.0);
+				chunk.badRecords++;
+			}
+			chunk.positions.push_back(v);
+		} else if (p + 2 < end && p[0] == 'v' && p[1] == 't' && isBlank(p[2])) {
+			const char* q = p + 3;
+			dvec2 vt(0.0, 0.0);
+			if (parseDouble(q, end, vt.x)) {
+				parseDouble(q, end, vt.y);		// v is optional
+			} else {
+				chunk.badRecords++;
+			}
+			chunk.texCoords.push_back(vt);
+		} else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && isBlank(p[2])) {
+			const char* q = p + 3;
+			dvec3 vn;
+			if (!(parseDouble(q, end, vn.x) && parseDouble(q, end, vn.y) && parseDouble(q, end, vn.z))) {
+				vn = dvec3(0.0, 0.0, 0.0);
+				chunk.badRecords++;
+			}
+			chunk.normals.push_back(vn);
+		} else if (p + 1 < end && p[0] == 'f' && isBlank(p[1])) {
+			const int count[3] = { (int)chunk.positions.size(), (int)chunk.texCoords.size(),
+									(int)chunk.normals.size() };
+			const char* q = p + 2;
+			face.clear();
+			faceFlags.clear();
+			while (true) {
+				q = skipBlanks(q, end);
+				if (q >= end || *q == '\n' || *q == '\r' || *q == '#') {
+					break;
+				}
+				ObjCorner corner;
+				uint8_t flags;
+				if (!parseCorner(q, end, count, corner, flags)) {
+					face.clear();
+					break;
+				}
+				face.push_back(corner);
+				faceFlags.push_back(flags);
+			}
+			if (face.size() < 3) {
+				chunk.badFaces++;
+			}
+			for (size_t i = 1; i + 1 < face.size(); i++) {
+				const size_t FAN[3] = { 0, i, i + 1 };
+				for (size_t j : FAN) {
+					chunk.corners.push_back(face[j]);
+					chunk.flags.push_back(faceFlags[j]);
+				}
+			}
+		}
+		p = skipLine(p, end);
+	}
+}
+
+/**
+ * @fn	bool ObjData::read(const string &filename)
+ * @brief	Reads the geometry of an OBJ file, replacing any current contents.
+ *			Faces that cannot be parsed, or that refer to records that do not
+ *			exist, are dropped and counted in a single error message. Records
+ *			that cannot be parsed are kept as zeros and counted in another.
+ * @param	filename	The OBJ file.
+ * @return	False if the file could not be opened.
+ */
+
+bool ObjData::read(const string& filename) {
+	positions.clear();
+	texCoords.clear();
+	normals.clear();
+	corners.clear();
+
+	std::ifstream in(filename, std::ios::binary | std::ios::ate);
+	if (!in.is_open()) {
+		cout << "Error: Cannot open file " << filename << endl;
+		return false;
+	}
+	const size_t SIZE = (size_t)in.tellg();
+	vector<char> text(SIZE + 1);
+	in.seekg(0);
+	in.read(text.data(), SIZE);
+	text[SIZE] = '\0';
+	const char* begin = text.data();
+	const char* end = begin + SIZE;
+
+	// Split at line breaks into chunks of at least MIN_CHUNK bytes, one per thread.
+	const size_t MIN_CHUNK = 1 << 20;
+	const int NUM_CHUNKS = (int)std::min(SIZE / MIN_CHUNK + 1,
+		(size_t)WorkerPool::shared().size());
+	vector<const char*> bounds(NUM_CHUNKS + 1);
+	bounds[0] = begin;
+	bounds[NUM_CHUNKS] = end;
+	for (int i = 1; i < NUM_CHUNKS; i++) {
+		const char* p = std::max(begin + SIZE * i / NUM_CHUNKS, bounds[i - 1]);
+		bounds[i] = p < end ? skipLine(p, end) : end;
+	}
+
+	vector<ObjChunk> chunks(NUM_CHUNKS);
+	WorkerPool::shared().run(NUM_CHUNKS, [&](int i) {
+		parseChunk(bounds[i], bounds[i + 1], chunks[i]);
+	});
+
+	// Join the chunks, turning chunk-relative indices into absolute ones.
+	size_t numPositions = 0, numTexCoords = 0, numNormals = 0, numCorners = 0;
+	for (const ObjChunk& chunk : chunks) {
+		numPositions += chunk.positions.size();
+		numTexCoords += chunk.texCoords.size();
+		numNormals += chunk.normals.size();
+		numCorners += chunk.corners.size();
+	}
+	positions.reserve(numPositions);
+	texCoords.reserve(numTexCoords);
+	normals.reserve(numNormals);
+	corners.reserve(numCorners);
+
+	vector<uint8_t> flags;
+	flags.reserve(numCorners);
+	int badFaces = 0, badRecords = 0, badTriangles = 0;
+	for (const ObjChunk& chunk : chunks) {
+		const int32_t offset[3] = { (int32_t)positions.size(), (int32_t)texCoords.size(),
+									(int32_t)normals.size() };
+		positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+		texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+		normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+		badFaces += chunk.badFaces;
+		badRecords += chunk.badRecords;
+
+		for (size_t i = 0; i < chunk.corners.size(); i++) {
+			ObjCorner c = chunk.corners[i];
+			uint8_t f = chunk.flags[i];
+			if (f & (RELATIVE << 0)) c.position += offset[0];
+			if (f & (RELATIVE << 1)) c.texCoord += offset[1];
+			if (f & (RELATIVE << 2)) c.normal += offset[2];
+			corners.push_back(c);
+			flags.push_back(f);
+		}
+	}
+
+	// Drop triangles with a given index out of range. A relative index can
+	// resolve to NONE's value, so presence is taken from the flags.
+	auto isBad = [](int32_t index, size_t size, bool given) {
+		return given && (index < 0 || (size_t)index >= size);
+	};
+	size_t kept = 0;
+	for (size_t t = 0; t + 2 < corners.size(); t += 3) {
+		bool bad = false;
+		for (size_t j = t; j < t + 3; j++) {
+			bad = bad || isBad(corners[j].position, positions.size(), true) ||
+				isBad(corners[j].texCoord, texCoords.size(), (flags[j] & (GIVEN << 1)) != 0) ||
+				isBad(corners[j].normal, normals.size(), (flags[j] & (GIVEN << 2)) != 0);
+		}
+		if (bad) {
+			badTriangles++;
+			continue;
+		}
+		for (size_t j = t; j < t + 3; j++) {
+			corners[kept++] = corners[j];
+		}
+	}
+	corners.resize(kept);
+
+	if (badRecords > 0) {
+		cout << "Error: " << badRecords << " bad v, vt or vn records in " << filename << endl;
+	}
+	if (badFaces > 0) {
+		cout << "Error: " << badFaces << " bad faces in " << filename << endl;
+	}
+	if (badTriangles > 0) {
+		cout << "Error: " << badTriangles << " triangles with out of range indices in " << filename << endl;
+	}
+	return true;
+}
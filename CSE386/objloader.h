@@ -0,0 +1,54 @@
+/****************************************************
+ * 2016-2025 Eric Bachmann and Mike Zmuda
+ * All Rights Reserved.
+ * NOTICE:
+ * Dissemination of this information or reproduction
+ * of this material is prohibited unless prior written
+ * permission is granted.
+ ****************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include "defs.h"
+
+/**
+ * @struct	ObjCorner
+ * @brief	One corner of a triangle read from an OBJ file: 0-based indices of its
+ *			position, texture coordinate and normal. A missing texture coordinate
+ *			or normal has index NONE.
+ */
+
+struct ObjCorner {
+	static const int32_t NONE = -1;	//!< Index of an attribute the corner does not have
+
+	int32_t position;	//!< Index into ObjData::positions
+	int32_t texCoord;	//!< Index into ObjData::texCoords, or NONE
+	int32_t normal;		//!< Index into ObjData::normals, or NONE
+};
+
+/**
+ * @struct	ObjData
+ * @brief	The geometry of an OBJ file: its v, vt and vn records, and its faces,
+ *			triangulated as fans, three corners per triangle. Everything else in
+ *			the file (groups, materials, smoothing, lines) is skipped.
+ *
+ *			The file is read into memory with a single read. Large files are then
+ *			split at line breaks into one chunk per WorkerPool thread and the chunks
+ *			are parsed in parallel; numbers are converted with std::from_chars when
+ *			the library has it and strtod otherwise, and no strings are built.
+ *			Relative (negative) indices are resolved once the chunks are joined,
+ *			when it is known how many records precede each chunk.
+ */
+
+struct ObjData {
+	vector<dvec3> positions;	//!< v records
+	vector<dvec2> texCoords;	//!< vt records
+	vector<dvec3> normals;		//!< vn records
+	vector<ObjCorner> corners;	//!< Three per triangle
+
+	bool read(const string& filename);
+	size_t numTriangles() const { return corners.size() / 3; }
+	bool hasTexCoords() const { return !texCoords.empty(); }
+	bool hasNormals() const { return !normals.empty(); }
+};
@@ -8,7 +8,13 @@
  ****************************************************/
 
 #include <cmath>
+#include <atomic>
+#include <random>
 #include "rasterization.h"
+#include "utilities.h"
+#include "workerpool.h"
+
+bool fixedPointRasterization = false;
 
  /**
  * @fn	template <class T> T barycentricWeighting(double w1, double w2, double w3,
@@ -66,18 +72,10 @@ static void drawVerticalLine(FrameBuffer& fb, int x, int bottom, int top, const
  */
 
 static void drawHorizontalLine(FrameBuffer& fb, int y, int left, int right, const color& rgb) {
-	const int H = fb.getWindowHeight();
-	const int W = fb.getWindowWidth();
-
 	if (left > right) {
 		std::swap(left, right);
 	}
-	left = left < 0 ? 0 : left;
-	right = right >= W ? W - 1 : right;
-	for (int x = left; x <= right; x++) {
-		if (inRectangle((double)x, (double)y, 0.0, 0.0, W - 1.0, H - 1.0))
-			fb.setColor(x, y, rgb);
-	}
+	fb.setColorSpan(left, y, right - left + 1, rgb);
 }
 
 /**
@@ -222,343 +220,194 @@ void drawAxisOnWindow(FrameBuffer& fb) {
 }
 
 /**
- * @fn	double cheapNonPerspectiveCorrectInterpolationForLines(const dvec2 &start, const dvec2 &end,
- *																const dvec2 &online)
- * @brief	Cheap non perspective correct interpolation for lines
- * @param	start 	The starting vertex.
- * @param	end   	The ending vertex
- * @param	online	The 2D point to interpolate.
- * @return	Interpolated value.
- */
-
-static double cheapNonPerspectiveCorrectInterpolationForLines(const dvec2& start, const dvec2& end,
-	const dvec2& online) {
-	return glm::length(online - start) / glm::length(end - start);
-}
-
-/**
- * @fn	void drawVerticalLine(FrameBuffer &frameBuffer, const dvec3 &eyePos,
- *									const vector<LightSourcePtr> &lights,
- *									VertexData v0, VertexData v1, const dmat4 &viewingMatrix)
- * @brief	Draw vertical line
- * @param [in,out]	frameBuffer  	Framebuffer.
- * @param 		  	eyePos		 	Eye position.
- * @param 		  	lights		 	Vector of lights in scene.
- * @param 		  	v0			 	The first endpoint.
- * @param 		  	v1			 	The second endpoint.
- * @param 		  	eyeFrame	    The camera's frame.
+ * @fn	static void interpolateVaryings(const VaryingLayout &layout, int n, const double *weights,
+ *										const float * const *varyings, const VertexData * const *verts,
+ *										Fragment &fragment)
+ * @brief	Interpolates the declared varyings of n (2 or 3) vertices perspective-correctly
+ *			and stores them in a fragment. Screen-space weights are turned into
+ *			perspective-correct ones by weighting each vertex by its 1/w. The
+ *			fragment gets the first vertex's material id; if VARYING_COLOR is
+ *			declared, unpack replaces it with the blended material.
+ * @param 		  	layout  	The varying layout.
+ * @param 		  	n			Number of vertices.
+ * @param 		  	weights 	Screen-space weights of the vertices.
+ * @param 		  	varyings	Packed varyings of the vertices.
+ * @param 		  	verts		The vertices.
+ * @param [in,out]	fragment	The fragment.
  */
 
-static void drawVerticalLine(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights, VertexData v0, VertexData v1,
-	const Frame& eyeFrame) {
-	if (v1.pos.y < v0.pos.y) {
-		std::swap(v0, v1);
+static inline void interpolateVaryings(const VaryingLayout& layout, int n, const double* weights,
+	const float* const* varyings, const VertexData* const* verts, Fragment& fragment) {
+	double pw[3];
+	double sum = 0.0;
+	for (int i = 0; i < n; i++) {
+		pw[i] = weights[i] * verts[i]->invW;
+		sum += pw[i];
+	}
+	for (int i = 0; i < n; i++) {
+		pw[i] /= sum;
 	}
 
-	double zDifference = v1.pos.z - v0.pos.z;
-
-	for (double y = v0.pos.y; y < v1.pos.y; y++) {
-		// Interpolate vertex attributes
-		double weight = cheapNonPerspectiveCorrectInterpolationForLines(v0.pos.xy(),
-			v1.pos.xy(),
-			dvec2(v0.pos.x, y));
-
-		Fragment fragment;
-
-		// Interpolate vertex attributes using alpha, beta, and gamma weights
-		double oneMinusW = 1.0 - weight;
-		fragment.material = weightedAverage(oneMinusW, v0.material, weight, v1.material);
-		double z = weightedAverage(oneMinusW, v0.pos.z, weight, v1.pos.z);
-		fragment.worldNormal = weightedAverage(oneMinusW, v0.normal, weight, v1.normal);
-		fragment.worldPos = weightedAverage(oneMinusW, v0.worldPos, weight, v1.worldPos);
-		fragment.windowPos = dvec3(v0.pos.x, y, z);
-
-		FragmentOps::processFragment(frameBuffer, eyePos, lights, fragment, eyeFrame);
+	float values[VaryingLayout::MAX_FLOATS];
+	for (int k = 0; k < layout.size; k++) {
+		double v = 0.0;
+		for (int i = 0; i < n; i++) {
+			v += pw[i] * varyings[i][k];
+		}
+		values[k] = (float)v;
 	}
+	fragment.materialID = verts[0]->materialID;
+	layout.unpack(values, fragment);
 }
 
 /**
- * @fn	static void drawHorizontalLine(FrameBuffer &frameBuffer, const dvec3 &eyePos,
- *										const vector<LightSourcePtr> &lights,
- *										VertexData v0, VertexData v1, const Frame &eyeFrame)
- * @brief	Draw horizontal line
- * @param [in,out]	frameBuffer  	Framebuffer.
- * @param 		  	eyePos		 	Eye position.
- * @param 		  	lights		 	Vector of lights in scene.
- * @param 		  	v0			 	The first endpoint.
- * @param 		  	v1			 	The second endpoint.
- * @param 		  	eyeFrame		The camera frame.
+ * @struct	LineAttributes
+ * @brief	The endpoints of a line being drawn, with their varyings packed once
+ *			for all of the line's pixels.
  */
 
-static void drawHorizontalLine(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights, VertexData v0, VertexData v1,
-	const Frame& eyeFrame) {
-	if (v1.pos.x < v0.pos.x) {
-		std::swap(v0, v1);
+struct LineAttributes {
+	const VertexData* v[2];						//!< The endpoints
+	const float* varyings[2];					//!< Each endpoint's packed varyings
+	float packed[2][VaryingLayout::MAX_FLOATS];	//!< Storage for the packed varyings
+	const VaryingLayout& layout;				//!< How the varyings are packed
+	LineAttributes(const VaryingLayout& layout, const VertexData& v0, const VertexData& v1)
+		: v{ &v0, &v1 }, varyings{ packed[0], packed[1] }, layout(layout) {
+		layout.pack(v0, packed[0]);
+		layout.pack(v1, packed[1]);
 	}
-
-	for (double x = v0.pos.x; x < v1.pos.x; x++) {
-		// Interpolate vertex attributes
-		double weight = cheapNonPerspectiveCorrectInterpolationForLines(v0.pos.xy(),
-			v1.pos.xy(),
-			dvec2(x, v0.pos.y));
-
-		Fragment fragment;
-
-		// Interpolate vertex attributes using alpha, beta, and gamma weights
-		fragment.material = weightedAverage(1.0 - weight, v0.material, weight, v1.material);
-		double z = weightedAverage(1 - weight, v0.pos.z, weight, v1.pos.z);
-		fragment.worldNormal = weightedAverage(1.0 - weight, v0.normal, weight, v1.normal);
-		fragment.worldPos = weightedAverage(1.0 - weight, v0.worldPos, weight, v1.worldPos);
-		fragment.windowPos = dvec3(x, v1.pos.y, z);
-
-		FragmentOps::processFragment(frameBuffer, eyePos, lights, fragment, eyeFrame);
-	}
-}
+};
 
 /**
- * @fn	static void midPointLine(FrameBuffer &frameBuffer, const dvec3 &eyePos, const vector<LightSourcePtr> &lights, VertexData v0, VertexData v1, const dmat4 &viewingMatrix)
- * @brief	Middle point line
- * @param [in,out]	frameBuffer  	Framebuffer.
- * @param 		  	eyePos		 	Eye position.
- * @param 		  	lights		 	Vector of lights in scene.
- * @param 		  	v0			 	The first endpoint.
- * @param 		  	v1			 	The second endpoint.
- * @param 		  	eyeFrame		The camera frame.
+ * @fn	static void rasterizeLine(FrameBuffer &frameBuffer, const ShadingContext &context,
+ *								const LineAttributes &line)
+ * @brief	Draws a line with integer Bresenham stepping, in every octant. The
+ *			endpoints are truncated to pixels and the line takes one pixel per step
+ *			along its major axis, so the error term, the pixel, depth and the
+ *			interpolation parameter all advance by constant increments; the
+ *			fragment is built once and only its position and varyings change.
+ *			The last pixel is left out, so lines meeting at an endpoint draw it
+ *			once. Depth is interpolated linearly in screen space; the varyings are
+ *			interpolated perspective-correctly. Pixels outside the window are skipped.
+ * @param [in,out]	frameBuffer	Framebuffer.
+ * @param 		  	context	The draw's shading context.
+ * @param 		  	line	   	The line's endpoints and varyings.
  */
 
-static void midPointLine(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights, VertexData v0, VertexData v1,
-	const Frame& eyeFrame) {
-	if (v1.pos.x < v0.pos.x) {
-		std::swap(v0, v1);
+static void rasterizeLine(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const LineAttributes& line) {
+	const VertexData& v0 = *line.v[0];
+	const VertexData& v1 = *line.v[1];
+	const int W = frameBuffer.getWindowWidth();
+	const int H = frameBuffer.getWindowHeight();
+
+	int x = (int)v0.pos.x;
+	int y = (int)v0.pos.y;
+	const int X1 = (int)v1.pos.x;
+	const int Y1 = (int)v1.pos.y;
+	const int DX = std::abs(X1 - x);
+	const int DY = std::abs(Y1 - y);
+	const int SX = x < X1 ? 1 : -1;
+	const int SY = y < Y1 ? 1 : -1;
+	const int STEPS = std::max(DX, DY);
+	if (STEPS == 0) {
+		return;
 	}
 
-	// Calculate slope of the line
-	double m = (v1.pos.y - v0.pos.y) / (v1.pos.x - v0.pos.x);
-
-	if (m > 0 && m < 1.0) { // For slope in (0,1] More "run" than "rise"
-		double y = v0.pos.y;
-
-		for (double x = v0.pos.x; x < v1.pos.x; x += 1.0) {
-
-			// Interpolate vertex attributes
-			double weight = cheapNonPerspectiveCorrectInterpolationForLines(v0.pos.xy(),
-				v1.pos.xy(),
-				dvec2(x, y));
-
-			Fragment fragment;
-
-			// Interpolate vertex attributes using alpha, beta, and gamma weights
-			fragment.material = weightedAverage(1.0 - weight, v0.material, weight, v1.material);
-			double z = weightedAverage(1 - weight, v0.pos.z, weight, v1.pos.z);
-			fragment.worldNormal = weightedAverage(1.0 - weight, v0.normal, weight, v1.normal);
-			fragment.worldPos = weightedAverage(1.0 - weight, v0.worldPos, weight, v1.worldPos);
+	const double DT = 1.0 / STEPS;
+	const double DZ = (v1.pos.z - v0.pos.z) * DT;
+	double t = 0.0;
+	double z = v0.pos.z;
+	int err = DX - DY;
+	Fragment fragment;
+	for (int i = 0; i < STEPS; i++) {
+		if (x >= 0 && y >= 0 && x < W && y < H) {
+			const double weights[2] = { 1.0 - t, t };
+			interpolateVaryings(line.layout, 2, weights, line.varyings, line.v, fragment);
 			fragment.windowPos = dvec3(x, y, z);
-
-			FragmentOps::processFragment(frameBuffer, eyePos, lights, fragment, eyeFrame);
-
-			// Evaluate the implicit equation for the line to determine if
-			// the line will be above the midpoint between the pixel centers.
-			double fXY = (v0.pos.y - v1.pos.y) * (x + 1.0) +
-				(v1.pos.x - v0.pos.x) * (y + 0.5) +
-				v0.pos.x * v1.pos.y - v1.pos.x * v0.pos.y;
-
-			if (fXY < 0) {
-				y += 1.0;
-			}
+			FragmentOps::processFragment(frameBuffer, context, fragment);
 		}
-	} else if (m > 1) { // For slope in (1,infinity] More "run" than "rise"
-		double x = v0.pos.x;
-
-		for (double y = v0.pos.y; y < v1.pos.y; y += 1.0) {
-
-			// Interpolate vertex attributes
-			double weight = cheapNonPerspectiveCorrectInterpolationForLines(v0.pos.xy(),
-				v1.pos.xy(),
-				dvec2(x, y));
-
-			Fragment fragment;
-
-			// Interpolate vertex attributes using alpha, beta, and gamma weights
-			fragment.material = weightedAverage(1.0 - weight, v0.material, weight, v1.material);
-			double z = weightedAverage(1 - weight, v0.pos.z, weight, v1.pos.z);
-			fragment.worldNormal = weightedAverage(1.0 - weight, v0.normal, weight, v1.normal);
-			fragment.worldPos = weightedAverage(1.0 - weight, v0.worldPos, weight, v1.worldPos);
-			fragment.windowPos = dvec3(x, y, z);
-
-			FragmentOps::processFragment(frameBuffer, eyePos, lights, fragment, eyeFrame);
-
-			// Evaluate the implicit equation for the line to determine if
-			// the line will be left or right the midpoint between the pixel centers.
-			double fXY = (v0.pos.y - v1.pos.y) * (x + 0.5) +
-				(v1.pos.x - v0.pos.x) * (y + 1.0) +
-				v0.pos.x * v1.pos.y - v1.pos.x * v0.pos.y;
-
-			if (fXY > 0) {
-				x += 1.0;
-			}
+		int e2 = 2 * err;
+		if (e2 > -DY) {
+			err -= DY;
+			x += SX;
 		}
-	} else if (m >= -1.0 && m < 0) { // For slope in [-1,0) More "run" than "rise"
-		double y = v0.pos.y;
-		double x = v0.pos.x;
-
-		for (double x = v0.pos.x; x < v1.pos.x; x += 1.0) {
-			// Interpolate vertex attributes
-			double weight = cheapNonPerspectiveCorrectInterpolationForLines(v0.pos.xy(),
-				v1.pos.xy(),
-				dvec2(x, y));
-
-			Fragment fragment;
-
-			// Interpolate vertex attributes using alpha, beta, and gamma weights
-			fragment.material = weightedAverage(1.0 - weight, v0.material, weight, v1.material);
-			double z = weightedAverage(1 - weight, v0.pos.z, weight, v1.pos.z);
-			fragment.worldNormal = weightedAverage(1.0 - weight, v0.normal, weight, v1.normal);
-			fragment.worldPos = weightedAverage(1.0 - weight, v0.worldPos, weight, v1.worldPos);
-			fragment.windowPos = dvec3(x, y, z);
-
-			FragmentOps::processFragment(frameBuffer, eyePos, lights, fragment, eyeFrame);
-
-			// Evaluate the implicit equation for the line to determine if
-			// the line will be below the midpoint between the pixel centers.
-			double fXY = (v0.pos.y - v1.pos.y) * (x + 1.0) +
-				(v1.pos.x - v0.pos.x) * (y - 0.5) +
-				v0.pos.x * v1.pos.y - v1.pos.x * v0.pos.y;
-
-			if (fXY > 0) {
-				y -= 1.0;
-			}
-		}
-	} else if (m < -1) { // For slope in [-infinity,-1) More "run" than "rise"
-		double x = v0.pos.x;
-
-		for (double y = v0.pos.y; y > v1.pos.y; y -= 1.0) {
-
-			// Interpolate vertex attributes
-			double weight = cheapNonPerspectiveCorrectInterpolationForLines(v0.pos.xy(),
-				v1.pos.xy(),
-				dvec2(x, y));
-
-			Fragment fragment;
-
-			// Interpolate vertex attributes using alpha, beta, and gamma weights
-			fragment.material = weightedAverage(1.0 - weight, v0.material, weight, v1.material);
-			double z = weightedAverage(1 - weight, v0.pos.z, weight, v1.pos.z);
-			fragment.worldNormal = weightedAverage(1.0 - weight, v0.normal, weight, v1.normal);
-			fragment.worldPos = weightedAverage(1.0 - weight, v0.worldPos, weight, v1.worldPos);
-			fragment.windowPos = dvec3(x, y, z);
-
-			FragmentOps::processFragment(frameBuffer, eyePos, lights, fragment, eyeFrame);
-
-			// Evaluate the implicit equation for the line to determine if
-			// the line will be left or right the midpoint between the pixel centers.
-			double fXY = (v0.pos.y - v1.pos.y) * (x + 0.5) +
-				(v1.pos.x - v0.pos.x) * (y - 1.0) +
-				v0.pos.x * v1.pos.y - v1.pos.x * v0.pos.y;
-
-			if (fXY < 0) {
-				x += 1.0;
-			}
+		if (e2 < DX) {
+			err += DX;
+			y += SY;
 		}
+		t += DT;
+		z += DZ;
 	}
 }
 
 /**
- * @fn	void drawLine(FrameBuffer &frameBuffer, const dvec3 &eyePos,
- *						const vector<LightSourcePtr> &lights,
- *						const VertexData &v0, const VertexData &v1, const Frame &eyeFrame)
+ * @fn	void drawLine(FrameBuffer &frameBuffer, const ShadingContext &context,
+ *						const VertexData &v0, const VertexData &v1)
  * @brief	Draw line
  * @param [in,out]	frameBuffer  	Framebuffer.
- * @param 		  	eyePos		 	Eye position.
- * @param 		  	lights		 	Vector of lights in scene.
+ * @param 		  	context		The draw's shading context.
  * @param 		  	v0			 	The first endpoint.
  * @param 		  	v1			 	The second endpoint.
- * @param 		  	eyeFrame		The camera frame.
  */
 
-void drawLine(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights,
-	const VertexData& v0, const VertexData& v1,
-	const Frame& eyeFrame) {
-	if (v0.pos.x == v1.pos.x) {
-		drawVerticalLine(frameBuffer, eyePos, lights, v0, v1, eyeFrame);
-	} else if (v0.pos.y == v1.pos.y) {
-		drawHorizontalLine(frameBuffer, eyePos, lights, v0, v1, eyeFrame);
-	} else {
-		midPointLine(frameBuffer, eyePos, lights, v0, v1, eyeFrame);
-	}
+void drawLine(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const VertexData& v0, const VertexData& v1) {
+	rasterizeLine(frameBuffer, context, LineAttributes(context.layout, v0, v1));
 }
 
 /**
- * @fn	void drawManyLines(FrameBuffer &frameBuffer, const dvec3 &eyePos,
- *							const vector<LightSourcePtr> &lights,
- *							const vector<VertexData> &vertices, const Frame &eyeFrame)
+ * @fn	void drawManyLines(FrameBuffer &frameBuffer, const ShadingContext &context,
+ *							const vector<VertexData> &vertices)
  * @brief	Draw many lines
  * @param [in,out]	frameBuffer  	Framebuffer.
- * @param 		  	eyePos		 	Eye position.
- * @param 		  	lights		 	Vector of lights in scene.
+ * @param 		  	context		The draw's shading context.
  * @param 		  	vertices	 	Vector of vertice-pairs.
- * @param 		  	eyeFrame		The camera frame.
  */
 
-void drawManyLines(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights,
-	const vector<VertexData>& vertices,
-	const Frame& eyeFrame) {
+void drawManyLines(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const vector<VertexData>& vertices) {
 	for (unsigned int i = 0; (i + 1) < vertices.size(); i += 2) {
-		drawLine(frameBuffer, eyePos, lights, vertices[i], vertices[i + 1], eyeFrame);
+		drawLine(frameBuffer, context, vertices[i], vertices[i + 1]);
 	}
 }
 
 /**
- * @fn	void drawWireFrameTriangle(FrameBuffer &frameBuffer, const dvec3 &eyePos,
- *									const vector<LightSourcePtr> &lights,
- *									const VertexData &v0, const VertexData &v1, const VertexData &v2,
- *									const Frame &eyeFrame)
+ * @fn	void drawWireFrameTriangle(FrameBuffer &frameBuffer, const ShadingContext &context,
+ *									const VertexData &v0, const VertexData &v1, const VertexData &v2)
  * @brief	Draw wire frame triangle.
  * @param [in,out]	frameBuffer  	Framebuffer.
- * @param 		  	eyePos		 	Eye position.
- * @param 		  	lights		 	Vector of lights in scene.
+ * @param 		  	context		The draw's shading context.
  * @param 		  	v0			 	First VertexData.
  * @param 		  	v1			 	Second VertexData.
  * @param 		  	v2			 	Third VertexData.
- * @param 		  	eyeFrame		The camera frame.
  */
 
 void drawWireFrameTriangle(FrameBuffer& frameBuffer,
-	const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights,
+	const ShadingContext& context,
 	const VertexData& v0,
 	const VertexData& v1,
-	const VertexData& v2,
-	const Frame& eyeFrame) {
-	drawLine(frameBuffer, eyePos, lights, v0, v1, eyeFrame);
-	drawLine(frameBuffer, eyePos, lights, v1, v2, eyeFrame);
-	drawLine(frameBuffer, eyePos, lights, v2, v0, eyeFrame);
+	const VertexData& v2) {
+	drawLine(frameBuffer, context, v0, v1);
+	drawLine(frameBuffer, context, v1, v2);
+	drawLine(frameBuffer, context, v2, v0);
 }
 
 /**
- * @fn	void drawManyWireFrameTriangles(FrameBuffer &frameBuffer, const dvec3 &eyePos,
- *										const vector<LightSourcePtr> &lights,
- *										const vector<VertexData> &vertices, const Frame &eyeFrame)
+ * @fn	void drawManyWireFrameTriangles(FrameBuffer &frameBuffer, const ShadingContext &context,
+ *										const vector<VertexData> &vertices)
  * @brief	Draw many wire frame triangles
  * @param [in,out]	frameBuffer  	Framebuffer.
- * @param 		  	eyePos		 	Eye position.
- * @param 		  	lights		 	Vector of lights in scene.
+ * @param 		  	context		The draw's shading context.
  * @param 		  	vertices	 	The vector of vertex-triplets.
- * @param 		  	eyeFrame		The camera frame.
  */
 
 void drawManyWireFrameTriangles(FrameBuffer& frameBuffer,
-	const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights,
-	const vector<VertexData>& vertices,
-	const Frame& eyeFrame) {
+	const ShadingContext& context,
+	const vector<VertexData>& vertices) {
 	for (unsigned int i = 0; (i + 2) < vertices.size(); i += 3) {
-		drawWireFrameTriangle(frameBuffer, eyePos, lights,
-			vertices[i], vertices[i + 1], vertices[i + 2], eyeFrame);
+		drawWireFrameTriangle(frameBuffer, context,
+			vertices[i], vertices[i + 1], vertices[i + 2]);
 	}
 }
 
@@ -621,83 +470,690 @@ static inline double f20(const VertexData& v0, const VertexData& v1, const Verte
 }
 
 /**
- * @fn	void drawFilledTriangle(FrameBuffer &frameBuffer, const dvec3 &eyePos,
- *								const vector<LightSourcePtr> &lights,
- *								const VertexData &v0, const VertexData &v1, const VertexData &v2,
- *								const dmat4 &viewingMatrix)
+ * @struct	TriangleSetup
+ * @brief	Per-triangle constants for rasterizing a filled triangle. The edge
+ *			functions f12, f20 and f01 are affine in window position, so they are
+ *			stored as their value at (0, 0) plus how much they change per pixel in x
+ *			and in y. They are oriented so that the inside of the triangle is positive
+ *			and are kept unscaled, which makes them exact for integer vertex positions.
+ *			Multiplying by invArea2 turns them into the barycentric weights
+ *			(alpha, beta, gamma). The whole setup costs one divide per triangle.
+ */
+
+struct TriangleSetup {
+	dvec3 atOrigin;			//!< (f12, f20, f01) at window position (0, 0)
+	dvec3 dx;				//!< Change in (f12, f20, f01) per pixel in x
+	dvec3 dy;				//!< Change in (f12, f20, f01) per pixel in y
+	double invArea2;		//!< 1 / (twice the area of the triangle)
+	bool includeEdge[3];	//!< Whether pixels exactly on edge 12, 20 and 01 are drawn
+	int xMin, xMax;			//!< Bounding box, clipped to the window
+	int yMin, yMax;
+
+	bool setup(const VertexData& v0, const VertexData& v1, const VertexData& v2,
+		const BoundingBoxi& clipBox);
+	dvec3 edgesAt(double x, double y) const { return atOrigin + x * dx + y * dy; }
+	bool rowSpan(int y, int& left, int& right) const;
+	bool isInside(const dvec3& e) const;
+};
+
+/**
+ * @fn	bool TriangleSetup::setup(const VertexData &v0, const VertexData &v1, const VertexData &v2,
+ *									const BoundingBoxi &clipBox)
+ * @brief	Computes the edge coefficients and bounding box of a triangle.
+ * @param	v0	  	v0.
+ * @param	v1	  	v1.
+ * @param	v2	  	v2.
+ * @param	clipBox	Only pixels in this box will be visited (the window, or a tile).
+ * @return	False if the triangle has no area or misses clipBox entirely.
+ */
+
+bool TriangleSetup::setup(const VertexData& v0, const VertexData& v1, const VertexData& v2,
+	const BoundingBoxi& clipBox) {
+	xMin = std::max(clipBox.lx, (int)glm::floor(min(v0.pos.x, v1.pos.x, v2.pos.x)));
+	xMax = std::min(clipBox.lx + clipBox.width - 1, (int)glm::ceil(max(v0.pos.x, v1.pos.x, v2.pos.x)));
+	yMin = std::max(clipBox.ly, (int)glm::floor(min(v0.pos.y, v1.pos.y, v2.pos.y)));
+	yMax = std::min(clipBox.ly + clipBox.height - 1, (int)glm::ceil(max(v0.pos.y, v1.pos.y, v2.pos.y)));
+	if (xMin > xMax || yMin > yMax) {
+		return false;
+	}
+
+	// f12 at v0, f20 at v1 and f01 at v2 are all twice the signed area.
+	double area2 = f12(v0, v1, v2, v0.pos.x, v0.pos.y);
+	if (area2 == 0.0) {
+		return false;
+	}
+	double orientation = area2 > 0 ? 1.0 : -1.0;
+	invArea2 = 1.0 / std::abs(area2);
+
+	dx = dvec3(v1.pos.y - v2.pos.y, v2.pos.y - v0.pos.y, v0.pos.y - v1.pos.y) * orientation;
+	dy = dvec3(v2.pos.x - v1.pos.x, v0.pos.x - v2.pos.x, v1.pos.x - v0.pos.x) * orientation;
+	atOrigin = dvec3(f12(v0, v1, v2, 0, 0), f20(v0, v1, v2, 0, 0), f01(v0, v1, v2, 0, 0)) * orientation;
+
+	// A pixel lying exactly on an edge belongs to the triangle on the same side of
+	// the edge as the off-screen point (-1, -1), so shared edges are drawn once.
+	dvec3 offScreen = edgesAt(-1, -1);
+	for (int i = 0; i < 3; i++) {
+		includeEdge[i] = offScreen[i] > 0;
+	}
+	return true;
+}
+
+/**
+ * @fn	bool TriangleSetup::rowSpan(int y, int &left, int &right) const
+ * @brief	Finds the range of x values in row y that might be inside the triangle. The
+ *			range is widened by a pixel on each side, so exact inside tests are still
+ *			needed, but rows that miss the triangle are rejected without visiting
+ *			any pixels.
+ * @param	y			 	The row.
+ * @param [out]	left 	First pixel to test.
+ * @param [out]	right	Last pixel to test.
+ * @return	False if no pixel in the row can be inside the triangle.
+ */
+
+bool TriangleSetup::rowSpan(int y, int& left, int& right) const {
+	dvec3 w = atOrigin + (double)y * dy;
+	double lo = xMin;
+	double hi = xMax;
+	for (int i = 0; i < 3; i++) {
+		if (dx[i] > 0) {
+			lo = std::max(lo, std::ceil(-w[i] / dx[i]) - 1.0);
+		} else if (dx[i] < 0) {
+			hi = std::min(hi, std::floor(-w[i] / dx[i]) + 1.0);
+		} else if (w[i] < 0) {
+			return false;
+		}
+	}
+	if (lo > hi) {
+		return false;
+	}
+	left = (int)lo;
+	right = (int)hi;
+	return true;
+}
+
+/**
+ * @fn	bool TriangleSetup::isInside(const dvec3 &e) const
+ * @brief	Determines if a pixel belongs to the triangle.
+ * @param	e	The pixel's (f12, f20, f01), as oriented by setup.
+ * @return	True if the pixel should be drawn.
+ */
+
+bool TriangleSetup::isInside(const dvec3& e) const {
+	return (e.x > 0 || (e.x == 0 && includeEdge[0])) &&
+		(e.y > 0 || (e.y == 0 && includeEdge[1])) &&
+		(e.z > 0 || (e.z == 0 && includeEdge[2]));
+}
+
+/**
+ * @struct	TriangleAttributes
+ * @brief	What shadePixel needs to know about the triangle being drawn, other than
+ *			where it covers.
+ */
+
+struct TriangleAttributes {
+	const VertexData* v[3];			//!< The vertices
+	const float* varyings[3];		//!< Each vertex's packed varyings
+	const VaryingLayout* layout;	//!< How the varyings are packed
+};
+
+/**
+ * @struct	RasterBuffers
+ * @brief	Scratch storage for drawManyFilledTriangles. It keeps its capacity from
+ *			draw to draw, so once it has grown to fit the largest draw, packing and
+ *			binning do not allocate. There is a single static instance, so
+ *			drawManyFilledTriangles must not be called by two threads at once.
+ */
+
+struct RasterBuffers {
+	vector<float> packed;				//!< Every vertex's packed varyings
+	vector<TriangleAttributes> attribs;	//!< Per triangle
+	vector<vector<int>> bins;			//!< Per tile, the triangles touching it
+};
+
+static RasterBuffers rasterBuffers;
+
+/**
+ * @fn	static void shadePixel(FrameBuffer &frameBuffer, const ShadingContext &context,
+ *								const TriangleAttributes &attribs, int x, int y, const dvec3 &w, double z)
+ * @brief	Builds the fragment for a covered pixel and sends it on for processing.
+ *			When depth testing is on, the depth test is done first, so that pixels
+ *			behind what is already in the framebuffer never pay for interpolating
+ *			varyings. In deferred mode (the context has a G-buffer), the pixel's
+ *			surface is stored in the G-buffer to be lit later.
+ * @param [in,out]	frameBuffer	Framebuffer.
+ * @param 		  	context	The draw's shading context.
+ * @param 		  	attribs	   	The triangle's vertices and varyings.
+ * @param 		  	x		   	The x coordinate of the pixel.
+ * @param 		  	y		   	The y coordinate of the pixel.
+ * @param 		  	w		   	The pixel's barycentric weights (alpha, beta, gamma).
+ * @param 		  	z		   	The pixel's interpolated depth.
+ */
+
+static inline void shadePixel(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const TriangleAttributes& attribs, int x, int y, const dvec3& w, double z) {
+	if (context.performDepthTest && (PixelReal)z >= frameBuffer.getDepth(x, y)) {
+		return;
+	}
+	Fragment fragment;
+	const double weights[3] = { w.x, w.y, w.z };
+	interpolateVaryings(*attribs.layout, 3, weights, attribs.varyings, attribs.v, fragment);
+
+	if (context.gBuffer != nullptr) {
+		context.gBuffer->write(x, y, fragment);
+		if (!context.readonlyDepthBuffer) {
+			frameBuffer.setDepth(x, y, z);
+		}
+		return;
+	}
+	fragment.windowPos = dvec3(x, y, z);
+	FragmentOps::processFragment(frameBuffer, context, fragment);
+}
+
+/**
+ * @fn	template <class SHADE> static void rasterizeRows(const TriangleSetup &tri,
+ *														double z0, double z1, double z2,
+ *														SHADE shade)
+ * @brief	Visits the triangle's bounding box a row at a time, stepping the edge
+ *			functions from pixel to pixel and testing each pixel.
+ * @param	tri  	The triangle.
+ * @param	z0   	Depth of v0.
+ * @param	z1   	Depth of v1.
+ * @param	z2   	Depth of v2.
+ * @param	shade	Called as shade(x, y, w, z) for each covered pixel.
+ */
+
+template <class SHADE>
+static void rasterizeRows(const TriangleSetup& tri, double z0, double z1, double z2,
+	SHADE shade) {
+	for (int y = tri.yMin; y <= tri.yMax; y++) {
+		int left, right;
+		if (!tri.rowSpan(y, left, right)) {
+			continue;
+		}
+		// Edges are evaluated directly at the start of each row so that stepping
+		// error cannot build up over the whole triangle.
+		dvec3 e = tri.edgesAt(left, y);
+		for (int x = left; x <= right; x++, e += tri.dx) {
+			if (tri.isInside(e)) {
+				dvec3 w = e * tri.invArea2;
+				shade(x, y, w, barycentricWeighting(w.x, w.y, w.z, z0, z1, z2));
+			}
+		}
+	}
+}
+
+#ifdef AVX2_PATHS
+/**
+ * @fn	template <class SHADE> static void rasterizeBlocks(const TriangleSetup &tri,
+ *															double z0, double z1, double z2,
+ *															SHADE shade)
+ * @brief	Visits the triangle's bounding box in 4x4 blocks, evaluating the edge
+ *			functions for a row of 4 pixels at a time. The edge values at a block's
+ *			corners classify the whole block: blocks entirely outside an edge are
+ *			skipped, and blocks entirely inside all three edges skip the per-pixel
+ *			coverage test. Depth is interpolated 4 pixels at a time as well.
+ * @param	tri  	The triangle.
+ * @param	z0   	Depth of v0.
+ * @param	z1   	Depth of v1.
+ * @param	z2   	Depth of v2.
+ * @param	shade	Called as shade(x, y, w, z) for each covered pixel.
+ */
+
+template <class SHADE>
+AVX2_TARGET static void rasterizeBlocks(const TriangleSetup& tri, double z0, double z1, double z2,
+	SHADE shade) {
+	const int B = 4;
+	const __m256d ZERO = _mm256_setzero_pd();
+	const __m256d LANE = _mm256_set_pd(3, 2, 1, 0);
+	const __m256d INV_AREA = _mm256_set1_pd(tri.invArea2);
+	const __m256d Z0 = _mm256_set1_pd(z0);
+	const __m256d Z1 = _mm256_set1_pd(z1);
+	const __m256d Z2 = _mm256_set1_pd(z2);
+	__m256d origin[3], dx[3], dy[3], onEdgeOK[3];
+	for (int i = 0; i < 3; i++) {
+		origin[i] = _mm256_set1_pd(tri.atOrigin[i]);
+		dx[i] = _mm256_set1_pd(tri.dx[i]);
+		dy[i] = _mm256_set1_pd(tri.dy[i]);
+		onEdgeOK[i] = _mm256_castsi256_pd(_mm256_set1_epi64x(tri.includeEdge[i] ? -1 : 0));
+	}
+
+	alignas(32) double alpha[B], beta[B], gamma[B], z[B];
+	for (int by = tri.yMin; by <= tri.yMax; by += B) {
+		const int BH = std::min(B, tri.yMax - by + 1);
+		for (int bx = tri.xMin; bx <= tri.xMax; bx += B) {
+			const int BW = std::min(B, tri.xMax - bx + 1);
+
+			// Classify the block by its four corners; the edges are affine, so if all
+			// corners are on one side of an edge, so is the whole block.
+			const __m256d CX = _mm256_set_pd(bx + BW - 1, bx, bx + BW - 1, bx);
+			const __m256d CY = _mm256_set_pd(by + BH - 1, by + BH - 1, by, by);
+			bool isOutside = false;
+			bool isFullyCovered = true;
+			for (int i = 0; i < 3 && !isOutside; i++) {
+				__m256d c = _mm256_add_pd(_mm256_add_pd(origin[i], _mm256_mul_pd(CX, dx[i])),
+										_mm256_mul_pd(CY, dy[i]));
+				isOutside = _mm256_movemask_pd(_mm256_cmp_pd(c, ZERO, _CMP_LT_OQ)) == 0xF;
+				isFullyCovered = isFullyCovered &&
+								_mm256_movemask_pd(_mm256_cmp_pd(c, ZERO, _CMP_GT_OQ)) == 0xF;
+			}
+			if (isOutside) {
+				continue;
+			}
+
+			const __m256d X = _mm256_add_pd(_mm256_set1_pd(bx), LANE);
+			for (int y = by; y < by + BH; y++) {
+				const __m256d Y = _mm256_set1_pd(y);
+				__m256d e[3];
+				int mask = (1 << BW) - 1;
+				for (int i = 0; i < 3; i++) {
+					e[i] = _mm256_add_pd(_mm256_add_pd(origin[i], _mm256_mul_pd(X, dx[i])),
+										_mm256_mul_pd(Y, dy[i]));
+					if (!isFullyCovered) {
+						__m256d inside = _mm256_or_pd(_mm256_cmp_pd(e[i], ZERO, _CMP_GT_OQ),
+							_mm256_and_pd(_mm256_cmp_pd(e[i], ZERO, _CMP_EQ_OQ), onEdgeOK[i]));
+						mask &= _mm256_movemask_pd(inside);
+					}
+				}
+				if (mask == 0) {
+					continue;
+				}
+				__m256d a = _mm256_mul_pd(e[0], INV_AREA);
+				__m256d b = _mm256_mul_pd(e[1], INV_AREA);
+				__m256d g = _mm256_mul_pd(e[2], INV_AREA);
+				_mm256_store_pd(alpha, a);
+				_mm256_store_pd(beta, b);
+				_mm256_store_pd(gamma, g);
+				_mm256_store_pd(z, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(a, Z0),
+												_mm256_mul_pd(b, Z1)), _mm256_mul_pd(g, Z2)));
+				for (int lane = 0; lane < BW; lane++) {
+					if (mask & (1 << lane)) {
+						shade(bx + lane, y, dvec3(alpha[lane], beta[lane], gamma[lane]), z[lane]);
+					}
+				}
+			}
+		}
+	}
+}
+#endif
+
+/**
+ * @struct	FixedPointEdge
+ * @brief	An edge function with vertices snapped to 1/256th of a pixel. All of the
+ *			arithmetic is exact 64-bit integer math: vertex coordinates take 24 bits,
+ *			so edge values need about 50.
+ */
+
+struct FixedPointEdge {
+	int64_t A, B, C;	//!< E(X, Y) = A*X + B*Y + C, in subpixel units
+	int64_t bias;		//!< 0 for top-left edges, -1 for the others
+
+	int64_t at(int64_t X, int64_t Y) const { return A * X + B * Y + C; }
+};
+
+static const int SUBPIXEL_BITS = 8;
+static const int64_t SUBPIXELS = (int64_t)1 << SUBPIXEL_BITS;
+
+/**
+ * @fn	static inline int64_t toFixed(double v)
+ * @brief	Snaps a window coordinate to the subpixel grid.
+ * @param	v	The coordinate.
+ * @return	The coordinate, in subpixel units.
+ */
+
+static inline int64_t toFixed(double v) {
+	return (int64_t)std::llround(v * SUBPIXELS);
+}
+
+/**
+ * @fn	static FixedPointEdge makeEdge(int64_t Xa, int64_t Ya, int64_t Xb, int64_t Yb)
+ * @brief	Builds the edge function for the directed edge from a to b. Points to the
+ *			left of the edge (which is the inside of a counter-clockwise triangle)
+ *			are positive. With y pointing up, an edge is a left edge when it goes
+ *			down, and a top edge when it is horizontal and goes to the left.
+ * @param	Xa	x of a.
+ * @param	Ya	y of a.
+ * @param	Xb	x of b.
+ * @param	Yb	y of b.
+ * @return	The edge function.
+ */
+
+static FixedPointEdge makeEdge(int64_t Xa, int64_t Ya, int64_t Xb, int64_t Yb) {
+	FixedPointEdge edge;
+	edge.A = Ya - Yb;
+	edge.B = Xb - Xa;
+	edge.C = Xa * Yb - Xb * Ya;
+	bool isTopLeft = (Yb < Ya) || (Yb == Ya && Xb < Xa);
+	edge.bias = isTopLeft ? 0 : -1;
+	return edge;
+}
+
+/**
+ * @fn	static void rasterizeFixedPoint(FrameBuffer &frameBuffer, const ShadingContext &context,
+ *										const TriangleAttributes &attribs,
+ *										const BoundingBoxi &clipBox)
+ * @brief	Draws the part of a filled triangle that lies within clipBox, using
+ *			integer edge functions on vertices snapped to 8 subpixel bits. Pixels on
+ *			an edge are drawn only if the edge is a top or left edge, so triangles
+ *			sharing an edge never both draw (or both miss) a pixel on it. Because the
+ *			edges are exact, each row's covered span is computed directly and needs
+ *			no per-pixel inside test.
+ * @param [in,out]	frameBuffer	Framebuffer.
+ * @param 		  	context	The draw's shading context.
+ * @param 		  	attribs	   	The triangle's vertices and varyings.
+ * @param 		  	clipBox	   	The pixels that may be drawn.
+ */
+
+static void rasterizeFixedPoint(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const TriangleAttributes& attribs, const BoundingBoxi& clipBox) {
+	const VertexData& v0 = *attribs.v[0];
+	const VertexData& v1 = *attribs.v[1];
+	const VertexData& v2 = *attribs.v[2];
+	int64_t X[3] = { toFixed(v0.pos.x), toFixed(v1.pos.x), toFixed(v2.pos.x) };
+	int64_t Y[3] = { toFixed(v0.pos.y), toFixed(v1.pos.y), toFixed(v2.pos.y) };
+
+	// Edge i is opposite vertex i, so its value is vertex i's barycentric weight.
+	// Clockwise triangles have their edges reversed so that inside is positive.
+	int64_t area2 = makeEdge(X[1], Y[1], X[2], Y[2]).at(X[0], Y[0]);
+	if (area2 == 0) {
+		return;
+	}
+	FixedPointEdge edges[3];
+	if (area2 > 0) {
+		edges[0] = makeEdge(X[1], Y[1], X[2], Y[2]);
+		edges[1] = makeEdge(X[2], Y[2], X[0], Y[0]);
+		edges[2] = makeEdge(X[0], Y[0], X[1], Y[1]);
+	} else {
+		edges[0] = makeEdge(X[2], Y[2], X[1], Y[1]);
+		edges[1] = makeEdge(X[0], Y[0], X[2], Y[2]);
+		edges[2] = makeEdge(X[1], Y[1], X[0], Y[0]);
+		area2 = -area2;
+	}
+	const double INV_AREA2 = 1.0 / (double)area2;
+
+	// Pixel (x, y) samples at subpixel (x * SUBPIXELS, y * SUBPIXELS).
+	auto ceilPixel = [](int64_t v) { return (int)((v + SUBPIXELS - 1) >> SUBPIXEL_BITS); };
+	auto floorPixel = [](int64_t v) { return (int)(v >> SUBPIXEL_BITS); };
+	int xMin = std::max(clipBox.lx, ceilPixel(std::min({ X[0], X[1], X[2] })));
+	int xMax = std::min(clipBox.lx + clipBox.width - 1, floorPixel(std::max({ X[0], X[1], X[2] })));
+	int yMin = std::max(clipBox.ly, ceilPixel(std::min({ Y[0], Y[1], Y[2] })));
+	int yMax = std::min(clipBox.ly + clipBox.height - 1, floorPixel(std::max({ Y[0], Y[1], Y[2] })));
+
+	for (int y = yMin; y <= yMax; y++) {
+		// Intersect the three half-planes E + bias >= 0 with this row.
+		// Offsets are kept relative to xMin, in 64 bits, until they are known to fit.
+		int64_t e[3];
+		int64_t first = 0;
+		int64_t last = xMax - xMin;
+		for (int i = 0; i < 3; i++) {
+			const FixedPointEdge& edge = edges[i];
+			e[i] = edge.at((int64_t)xMin * SUBPIXELS, (int64_t)y * SUBPIXELS);
+			int64_t biased = e[i] + edge.bias;
+			int64_t step = edge.A * SUBPIXELS;
+			if (step > 0) {
+				if (biased < 0) {
+					first = std::max(first, (-biased + step - 1) / step);
+				}
+			} else if (step < 0) {
+				last = biased < 0 ? -1 : std::min(last, biased / -step);
+			} else if (biased < 0) {
+				last = -1;
+			}
+		}
+		if (first > last) {
+			continue;
+		}
+		int left = xMin + (int)first;
+		int right = xMin + (int)last;
+
+		for (int i = 0; i < 3; i++) {
+			e[i] += (int64_t)(left - xMin) * edges[i].A * SUBPIXELS;
+		}
+		const int64_t STEP[3] = { edges[0].A * SUBPIXELS, edges[1].A * SUBPIXELS, edges[2].A * SUBPIXELS };
+		for (int x = left; x <= right; x++) {
+			dvec3 w = dvec3((double)e[0], (double)e[1], (double)e[2]) * INV_AREA2;
+			double z = barycentricWeighting(w.x, w.y, w.z, v0.pos.z, v1.pos.z, v2.pos.z);
+			shadePixel(frameBuffer, context, attribs, x, y, w, z);
+			e[0] += STEP[0];
+			e[1] += STEP[1];
+			e[2] += STEP[2];
+		}
+	}
+}
+
+/**
+ * @fn	static void rasterizeTriangle(FrameBuffer &frameBuffer, const ShadingContext &context,
+ *										const TriangleAttributes &attribs,
+ *										const BoundingBoxi &clipBox)
+ * @brief	Draws the part of a filled triangle that lies within clipBox. The edge
+ *			functions are set up once per triangle and then stepped from pixel to
+ *			pixel across each row (see rasterizeRows). When the CPU has AVX2, 4x4
+ *			blocks of pixels are handled together instead (see rasterizeBlocks).
+ *			fixedPointRasterization selects rasterizeFixedPoint.
+ * @param [in,out]	frameBuffer	Framebuffer.
+ * @param 		  	context	The draw's shading context.
+ * @param 		  	attribs	   	The triangle's vertices and varyings.
+ * @param 		  	clipBox	   	The pixels that may be drawn.
+ */
+
+static void rasterizeTriangle(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const TriangleAttributes& attribs, const BoundingBoxi& clipBox) {
+	if (fixedPointRasterization) {
+		rasterizeFixedPoint(frameBuffer, context, attribs, clipBox);
+		return;
+	}
+	const VertexData& v0 = *attribs.v[0];
+	const VertexData& v1 = *attribs.v[1];
+	const VertexData& v2 = *attribs.v[2];
+
+	TriangleSetup tri;
+	if (!tri.setup(v0, v1, v2, clipBox)) {
+		return;
+	}
+
+	auto shade = [&](int x, int y, const dvec3& w, double z) {
+		shadePixel(frameBuffer, context, attribs, x, y, w, z);
+	};
+#ifdef AVX2_PATHS
+	if (cpuHasAVX2()) {
+		rasterizeBlocks(tri, v0.pos.z, v1.pos.z, v2.pos.z, shade);
+		return;
+	}
+#endif
+	rasterizeRows(tri, v0.pos.z, v1.pos.z, v2.pos.z, shade);
+}
+
+/**
+ * @fn	int checkBlockCoverage(int numTriangles)
+ * @brief	Checks the AVX2 block rasterizer against the scalar one on random
+ *			triangles, so that neither can drift from the other unnoticed. Both
+ *			must cover exactly the same pixels, with the same weights and depth to
+ *			within rounding. Vertices are placed on a 1/256 pixel grid, on which the
+ *			edge functions are exact, so any difference in coverage is a real bug
+ *			rather than rounding. Some triangles have integer vertices, so pixels
+ *			fall exactly on edges, and some extend past the window, so they are
+ *			clipped.
+ * @param	numTriangles	How many triangles to test.
+ * @return	The number of triangles drawn differently, or -1 if the CPU does not
+ *			have AVX2 (so there is nothing to compare).
+ */
+
+int checkBlockCoverage(int numTriangles) {
+#ifdef AVX2_PATHS
+	if (!cpuHasAVX2()) {
+		return -1;
+	}
+	const int SIZE = 64;
+	const BoundingBoxi window(0, SIZE, 0, SIZE);
+	std::mt19937 random(386);
+	std::uniform_int_distribution<int> anywhere(-8 * 256, (SIZE + 8) * 256);
+	std::uniform_int_distribution<int> nearby(-8 * 256, 8 * 256);
+	std::uniform_real_distribution<double> depth(-1.0, 1.0);
+
+	vector<dvec4> rowPixels, blockPixels;	// (x, y, z, alpha) of each covered pixel
+	auto byPosition = [](const dvec4& a, const dvec4& b) {
+		return a.y != b.y ? a.y < b.y : a.x < b.x;
+	};
+	int mismatches = 0;
+	for (int t = 0; t < numTriangles; t++) {
+		dvec4 pos[3];
+		int cx = anywhere(random), cy = anywhere(random);
+		for (int i = 0; i < 3; i++) {
+			int x = t % 2 == 0 ? anywhere(random) : cx + nearby(random);
+			int y = t % 2 == 0 ? anywhere(random) : cy + nearby(random);
+			if (t % 3 == 0) {
+				x &= ~255;		// whole pixels
+				y &= ~255;
+			}
+			pos[i] = dvec4(x / 256.0, y / 256.0, depth(random), 1.0);
+		}
+		VertexData v0(pos[0]), v1(pos[1]), v2(pos[2]);
+		TriangleSetup tri;
+		if (!tri.setup(v0, v1, v2, window)) {
+			continue;
+		}
+
+		rowPixels.clear();
+		blockPixels.clear();
+		rasterizeRows(tri, v0.pos.z, v1.pos.z, v2.pos.z,
+			[&](int x, int y, const dvec3& w, double z) {
+				rowPixels.push_back(dvec4(x, y, z, w.x));
+			});
+		rasterizeBlocks(tri, v0.pos.z, v1.pos.z, v2.pos.z,
+			[&](int x, int y, const dvec3& w, double z) {
+				blockPixels.push_back(dvec4(x, y, z, w.x));
+			});
+		std::sort(rowPixels.begin(), rowPixels.end(), byPosition);
+		std::sort(blockPixels.begin(), blockPixels.end(), byPosition);
+
+		bool same = rowPixels.size() == blockPixels.size();
+		for (size_t i = 0; same && i < rowPixels.size(); i++) {
+			same = rowPixels[i].x == blockPixels[i].x && rowPixels[i].y == blockPixels[i].y &&
+				std::abs(rowPixels[i].z - blockPixels[i].z) < 1.0E-9 &&
+				std::abs(rowPixels[i].w - blockPixels[i].w) < 1.0E-9;
+		}
+		if (!same) {
+			mismatches++;
+		}
+	}
+	return mismatches;
+#else
+	(void)numTriangles;
+	return -1;
+#endif
+}
+
+/**
+ * @fn	void drawFilledTriangle(FrameBuffer &frameBuffer, const ShadingContext &context,
+ *								const VertexData &v0, const VertexData &v1, const VertexData &v2)
  * @brief	Draw filled triangle.
  * @param [in,out]	frameBuffer  	Framebuffer.
- * @param 		  	eyePos		 	Eye position.
- * @param 		  	lights		 	Vector of lights in scene.
+ * @param 		  	context		The draw's shading context.
  * @param 		  	v0			 	v0.
  * @param 		  	v1			 	v1.
  * @param 		  	v2			 	v2.
- * @param               eyeFrame        The camera's frame.
- */
-
-void drawFilledTriangle(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights,
-	const VertexData& v0, const VertexData& v1, const VertexData& v2,
-	const Frame& eyeFrame) {
-	// Find minimimum and maximum x and y limits for the triangle
-	double xMin = glm::floor(min(v0.pos.x, v1.pos.x, v2.pos.x));
-	double xMax = glm::ceil(max(v0.pos.x, v1.pos.x, v2.pos.x));
-	double yMin = glm::floor(min(v0.pos.y, v1.pos.y, v2.pos.y));
-	double yMax = glm::ceil(max(v0.pos.y, v1.pos.y, v2.pos.y));
-
-	double fAlpha = f12(v0, v1, v2, v0.pos.x, v0.pos.y);
-	double fBeta = f20(v0, v1, v2, v1.pos.x, v1.pos.y);
-	double fGamma = f01(v0, v1, v2, v2.pos.x, v2.pos.y);
-
-	for (double y = yMin; y <= yMax; y++) {
-		for (double x = xMin; x <= xMax; x++) {
-			// Calculate the weights for inperpolation
-			// If any weight is negative, the fragment is not in the triangle
-			double alpha = f12(v0, v1, v2, x, y) / fAlpha;
-			double beta = f20(v0, v1, v2, x, y) / fBeta;
-			double gamma = f01(v0, v1, v2, x, y) / fGamma;
-
-			// Determine if the pixel position is inside the triangle
-			if (alpha >= 0 && beta >= 0 && gamma >= 0) {
-				if ((alpha > 0 || fAlpha * f12(v0, v1, v2, -1, -1) > 0) &&
-					(beta > 0 || fBeta * f20(v0, v1, v2, -1, -1) > 0) &&
-					(gamma > 0 || fGamma * f01(v0, v1, v2, -1, -1) > 0)) {
-					Fragment fragment;
-
-					// Interpolate vertex attributes using alpha, beta, and gamma weights
-					fragment.material = barycentricWeighting(alpha, beta, gamma,
-						v0.material, v1.material, v2.material);
-					fragment.worldNormal = barycentricWeighting(alpha, beta, gamma,
-						v0.normal, v1.normal, v2.normal);
-					fragment.worldPos = barycentricWeighting(alpha, beta, gamma,
-						v0.worldPos, v1.worldPos, v2.worldPos);
-					double z = barycentricWeighting(alpha, beta, gamma,
-						v0.pos.z, v1.pos.z, v2.pos.z);
-					fragment.windowPos = dvec3(x, y, z);
-					FragmentOps::processFragment(frameBuffer, eyePos, lights, fragment, eyeFrame);
-				}
-			}
-		}
-	}
+ */
+
+void drawFilledTriangle(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const VertexData& v0, const VertexData& v1, const VertexData& v2) {
+	BoundingBoxi window(0, frameBuffer.getWindowWidth(), 0, frameBuffer.getWindowHeight());
+	const VaryingLayout& layout = context.layout;
+	float packed[3][VaryingLayout::MAX_FLOATS];
+	layout.pack(v0, packed[0]);
+	layout.pack(v1, packed[1]);
+	layout.pack(v2, packed[2]);
+
+	TriangleAttributes attribs = { { &v0, &v1, &v2 }, { packed[0], packed[1], packed[2] }, &layout };
+	rasterizeTriangle(frameBuffer, context, attribs, window);
 }
 
 /**
- * @fn	void drawManyFilledTriangles(FrameBuffer &frameBuffer, const dvec3 &eyePos, const vector<LightSourcePtr> &lights, const vector<VertexData> &vertices, const dmat4 &viewingMatrix)
- * @brief	Draw many filled triangles,
+ * @fn	void drawManyFilledTriangles(FrameBuffer &frameBuffer, const ShadingContext &context, const vector<VertexData> &vertices)
+ * @brief	Draw many filled triangles. The window is divided into tiles and each
+ *			triangle is put in the bin of every tile its bounding box touches. Worker
+ *			threads then take whole tiles, drawing each tile's triangles in the order
+ *			they were submitted. The threads are the shared WorkerPool's. Since only
+ *			one thread ever writes a given pixel, the results are the same as drawing
+ *			the triangles one after another, and the depth and color buffers need no
+ *			locking. Varyings are packed before the threads start. All scratch
+ *			storage is reused from draw to draw, so this is not reentrant.
  * @param [in,out]	frameBuffer  	Framebuffer.
- * @param 		  	eyePos		 	Eye position.
- * @param 		  	lights		 	Vector of lights in scene.
+ * @param 		  	context		The draw's shading context.
  * @param 		  	vertices	 	The vector of vertice-triplets.
- * @param 		  	eyeFrame    	The camera's frame.
  */
 
-void drawManyFilledTriangles(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights, const vector<VertexData>& vertices,
-	const Frame& eyeFrame) {
-	for (int i = 0; i < (int)vertices.size() - 2; i += 3) {
-		const VertexData& Vi = vertices[i];
-		const VertexData& Vi1 = vertices[i + 1];
-		const VertexData& Vi2 = vertices[i + 2];
-		drawFilledTriangle(frameBuffer, eyePos, lights, Vi, Vi1, Vi2, eyeFrame);
+void drawManyFilledTriangles(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const vector<VertexData>& vertices) {
+	const int TILE_SIZE = 64;
+	const int MIN_TRIANGLES_TO_BIN = 32;	// below this, threads cost more than they save
+	const int NUM_TRIANGLES = (int)vertices.size() / 3;
+	const int NUM_THREADS = WorkerPool::shared().size();
+	const int W = frameBuffer.getWindowWidth();
+	const int H = frameBuffer.getWindowHeight();
+
+	if (NUM_THREADS == 1 || NUM_TRIANGLES < MIN_TRIANGLES_TO_BIN) {
+		for (int i = 0; i < (int)vertices.size() - 2; i += 3) {
+			drawFilledTriangle(frameBuffer, context, vertices[i], vertices[i + 1], vertices[i + 2]);
+		}
+		return;
 	}
+
+	// Pack every vertex's varyings once, rather than once per tile the triangle touches.
+	const VaryingLayout& layout = context.layout;
+	vector<float>& packed = rasterBuffers.packed;
+	packed.resize(vertices.size() * layout.size);
+	for (size_t i = 0; i < vertices.size(); i++) {
+		layout.pack(vertices[i], packed.data() + i * layout.size);
+	}
+
+	vector<TriangleAttributes>& attribs = rasterBuffers.attribs;
+	attribs.resize(NUM_TRIANGLES);
+	for (int t = 0; t < NUM_TRIANGLES; t++) {
+		TriangleAttributes& A = attribs[t];
+		for (int i = 0; i < 3; i++) {
+			A.v[i] = &vertices[3 * t + i];
+			A.varyings[i] = packed.data() + (3 * t + i) * layout.size;
+		}
+		A.layout = &layout;
+	}
+
+	// Bin the triangles. Each bin lists triangles in submission order.
+	const int TILES_X = (W + TILE_SIZE - 1) / TILE_SIZE;
+	const int TILES_Y = (H + TILE_SIZE - 1) / TILE_SIZE;
+	const int NUM_TILES = TILES_X * TILES_Y;
+	vector<vector<int>>& bins = rasterBuffers.bins;
+	if ((int)bins.size() < NUM_TILES) {
+		bins.resize(NUM_TILES);
+	}
+	for (int tile = 0; tile < NUM_TILES; tile++) {
+		bins[tile].clear();
+	}
+	for (int t = 0; t < NUM_TRIANGLES; t++) {
+		const VertexData& v0 = vertices[3 * t];
+		const VertexData& v1 = vertices[3 * t + 1];
+		const VertexData& v2 = vertices[3 * t + 2];
+		int x0 = std::max(0, (int)glm::floor(min(v0.pos.x, v1.pos.x, v2.pos.x)));
+		int x1 = std::min(W - 1, (int)glm::ceil(max(v0.pos.x, v1.pos.x, v2.pos.x)));
+		int y0 = std::max(0, (int)glm::floor(min(v0.pos.y, v1.pos.y, v2.pos.y)));
+		int y1 = std::min(H - 1, (int)glm::ceil(max(v0.pos.y, v1.pos.y, v2.pos.y)));
+		for (int ty = y0 / TILE_SIZE; ty <= y1 / TILE_SIZE && y0 <= y1; ty++) {
+			for (int tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE && x0 <= x1; tx++) {
+				bins[ty * TILES_X + tx].push_back(t);
+			}
+		}
+	}
+
+	// Workers claim whole tiles; the counter is the only shared, mutable state.
+	std::atomic<int> nextTile(0);
+	auto worker = [&](int) {
+		for (int tile = nextTile++; tile < NUM_TILES; tile = nextTile++) {
+			int tx = tile % TILES_X;
+			int ty = tile / TILES_X;
+			BoundingBoxi box(tx * TILE_SIZE, std::min(TILE_SIZE, W - tx * TILE_SIZE),
+							ty * TILE_SIZE, std::min(TILE_SIZE, H - ty * TILE_SIZE));
+			for (int t : bins[tile]) {
+				rasterizeTriangle(frameBuffer, context, attribs[t], box);
+			}
+		}
+	};
+	WorkerPool::shared().run(NUM_THREADS, worker);
 }
@@ -13,31 +13,24 @@
 #include "fragmentops.h"
 #include "vertexdata.h"
 
+extern bool fixedPointRasterization;	//!< True ==> filled triangles use 24.8 fixed-point edges
+
 void drawAxisOnWindow(FrameBuffer& frameBuffer);
 void drawWirePolygon(FrameBuffer& frameBuffer, const vector<dvec3>& pts, const color& rgb);
 void drawLine(FrameBuffer& frameBuffer, int x1, int y1, int x2, int y2, const color& C);
 void drawLine(FrameBuffer& frameBuffer, const dvec2& pt1, const dvec2& pt2, const color& C);
-void drawLine(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	vector<LightSourcePtr>& lights,
-	const VertexData& v0, const VertexData& v1,
-	const Frame& eyeFrame);
-void drawManyLines(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights, const vector<VertexData>& vertices,
-	const Frame& eyeFrame);
-void drawWireFrameTriangle(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights,
-	const VertexData& v0, const VertexData& v1, const VertexData& v2,
-	const Frame& eyeFrame);
-void drawFilledTriangle(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	vector<LightSourcePtr>& lights, const VertexData& v0,
-	const VertexData& v1, const VertexData& v2,
-	const Frame& eyeFrame);
-void drawManyWireFrameTriangles(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights,
-	const vector<VertexData>& vertices,
-	const Frame& eyeFrame);
-void drawManyFilledTriangles(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights, const vector<VertexData>& vertices,
-	const Frame& eyeFrame);
+void drawLine(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const VertexData& v0, const VertexData& v1);
+void drawManyLines(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const vector<VertexData>& vertices);
+void drawWireFrameTriangle(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const VertexData& v0, const VertexData& v1, const VertexData& v2);
+void drawFilledTriangle(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const VertexData& v0, const VertexData& v1, const VertexData& v2);
+void drawManyWireFrameTriangles(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const vector<VertexData>& vertices);
+void drawManyFilledTriangles(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const vector<VertexData>& vertices);
+int checkBlockCoverage(int numTriangles);
 void drawArc(FrameBuffer& fb, const dvec2& center, double R,
 	double startRads, double lengthInRads, const color& rgb);
\ No newline at end of file
@@ -7,6 +7,7 @@
  * permission is granted.
  ****************************************************/
 #include "raytracer.h"
+#include "workerpool.h"
 #include "ishape.h"
 #include "io.h"
 
@@ -17,67 +18,143 @@
   */
 
 RayTracer::RayTracer(const color& defa)
-	: defaultColor(defa) {
+	: defaultColor(defa), showAxes(true) {
 }
 
 /**
- * @fn	void RayTracer::raytraceScene(FrameBuffer &frameBuffer, int depth, const IScene &theScene) const
+ * @fn	void RayTracer::raytraceScene(FrameBuffer &frameBuffer, int depth, const IScene &theScene, int N, bool display) const
  * @brief	Raytrace scene
  * @param [in,out]	frameBuffer	Framebuffer.
  * @param 		  	depth	   	The current depth of recursion.
  * @param 		  	theScene   	The scene.
+ * @param 		  	N		   	Anti-aliasing: N x N rays are traced per pixel.
+ * @param 		  	display	   	False for an offscreen framebuffer, which is not shown.
  */
 
 void RayTracer::raytraceScene(FrameBuffer& frameBuffer, int depth,
-	const IScene& theScene, int N) const {
+	const IScene& theScene, int N, bool display) const {
 	const RaytracingCamera& camera = *theScene.camera;
+	BoundingBoxi window(0, frameBuffer.getWindowWidth(), 0, frameBuffer.getWindowHeight());
 
-	for (int y = 0; y < frameBuffer.getWindowHeight(); ++y) {
-		for (int x = 0; x < frameBuffer.getWindowWidth(); ++x) {
-			DEBUG_PIXEL = (x == xDebug && y == yDebug);
-			if (DEBUG_PIXEL) {
-				cout << "";
+	raytraceRows(frameBuffer, depth, theScene, camera, window, N, 0, 1);
+
+	if (showAxes) {
+		frameBuffer.showAxes(camera, 0.25, window);
+	}
+
+	if (display) {
+		frameBuffer.showColorBuffer();
+	}
+}
+
+/**
+ * @fn	void RayTracer::raytraceViews(FrameBuffer &frameBuffer, int depth, const IScene &theScene,
+ *										const vector<RaytracingCamera*> &cameras,
+ *										const vector<BoundingBoxi> &viewports, int N) const
+ * @brief	Raytraces the scene from several cameras at once, each into its own viewport
+ *			of the same framebuffer (e.g., top, front, side and perspective views). The
+ *			rows of all the viewports are interleaved across the WorkerPool's
+ *			threads. All threads share the scene: tracing only calls const members of
+ *			the shapes and lights, and none of them keeps static or mutable state.
+ *			theScene.camera is not used.
+ * @param [in,out]	frameBuffer	Framebuffer.
+ * @param 		  	depth	   	The current depth of recursion.
+ * @param 		  	theScene   	The scene.
+ * @param 		  	cameras	   	One camera per view. Each camera should be constructed
+ *								with its viewport's width and height.
+ * @param 		  	viewports  	Where each view goes in the framebuffer.
+ * @param 		  	N		   	Anti-aliasing: N x N rays are traced per pixel.
+ */
+
+void RayTracer::raytraceViews(FrameBuffer& frameBuffer, int depth, const IScene& theScene,
+	const vector<RaytracingCamera*>& cameras,
+	const vector<BoundingBoxi>& viewports, int N) const {
+	const int NUM_VIEWS = (int)std::min(cameras.size(), viewports.size());
+	const int NUM_THREADS = WorkerPool::shared().size();
+
+	WorkerPool::shared().run(NUM_THREADS, [&](int t) {
+		for (int v = 0; v < NUM_VIEWS; v++) {
+			raytraceRows(frameBuffer, depth, theScene, *cameras[v], viewports[v],
+				N, t, NUM_THREADS);
+		}
+	});
+
+	if (showAxes) {
+		for (int v = 0; v < NUM_VIEWS; v++) {
+			frameBuffer.showAxes(*cameras[v], 0.25, viewports[v]);
+		}
+	}
+
+	frameBuffer.showColorBuffer();
+}
+
+/**
+ * @fn	void RayTracer::raytraceRows(FrameBuffer &frameBuffer, int depth, const IScene &theScene,
+ *										const RaytracingCamera &camera, const BoundingBoxi &viewport,
+ *										int N, int firstRow, int rowStep) const
+ * @brief	Raytraces rows firstRow, firstRow + rowStep, ... of a viewport. Pixel debugging
+ *			(DEBUG_PIXEL) is only supported when a single caller does every row.
+ * @param [in,out]	frameBuffer	Framebuffer.
+ * @param 		  	depth	   	The current depth of recursion.
+ * @param 		  	theScene   	The scene.
+ * @param 		  	camera	   	The camera for this viewport.
+ * @param 		  	viewport   	The part of the framebuffer to fill.
+ * @param 		  	N		   	Anti-aliasing: N x N rays are traced per pixel.
+ * @param 		  	firstRow   	First row (relative to the viewport) to trace.
+ * @param 		  	rowStep	   	Distance between successive rows to trace.
+ */
+
+void RayTracer::raytraceRows(FrameBuffer& frameBuffer, int depth, const IScene& theScene,
+	const RaytracingCamera& camera, const BoundingBoxi& viewport,
+	int N, int firstRow, int rowStep) const {
+	const bool debugging = rowStep == 1;
+	const dvec3 eyePos = camera.getFrame().origin;
+	vector<color> rowColors(viewport.width);
+
+	for (int y = firstRow; y < viewport.height; y += rowStep) {
+		for (int x = 0; x < viewport.width; ++x) {
+			if (debugging) {
+				DEBUG_PIXEL = (viewport.lx + x == xDebug && viewport.ly + y == yDebug);
+				if (DEBUG_PIXEL) {
+					cout << "";
+				}
 			}
 
 			color sum = black;
-			Ray ray = camera.getRay(x, y);
 
 			for (int rayY = 0; rayY < N; rayY++) {
 				for (int rayX = 0; rayX < N; rayX++) {
-					ray = camera.getRay(static_cast<double>(x) + (rayX + 0.5) / static_cast<double>(N), static_cast<double>(y) + (rayY + 0.5) / static_cast<double>(N));
-					sum += traceIndividualRay(ray, theScene, depth, true);
+					Ray ray = camera.getRay(static_cast<double>(x) + (rayX + 0.5) / static_cast<double>(N), static_cast<double>(y) + (rayY + 0.5) / static_cast<double>(N));
+					sum += traceIndividualRay(ray, theScene, eyePos, depth, true);
 				}
 			}
 
-			color finalColor = sum / static_cast<double>(N * N);
-
-			frameBuffer.setColor(x, y, finalColor);
-			Ray centerRay = camera.getRay(static_cast<double>(x) + 0.5, static_cast<double>(y) + 0.5);
-			frameBuffer.showAxes(x, y, centerRay, 0.25);
+			rowColors[x] = sum / static_cast<double>(N * N);
 		}
+		frameBuffer.setColorSpan(viewport.lx, viewport.ly + y, viewport.width, rowColors.data());
 	}
-
-	frameBuffer.showColorBuffer();
 }
 
 /**
  * @fn	color RayTracer::traceIndividualRay(const Ray &ray,
  *											const IScene &theScene,
- *											int recursionLevel) const
+ *											const dvec3 &cameraOrigin,
+ *											int recursionLevel, bool isPrimaryRay) const
  * @brief	Trace an individual ray.
  * @param	ray			  	The ray.
  * @param	theScene	  	The scene.
+ * @param	cameraOrigin  	Position of the viewer, for lighting.
  * @param	recursionLevel	The recursion level.
+ * @param	isPrimaryRay  	True if the ray comes directly from the camera.
  * @return	The color to be displayed as a result of this ray.
  */
 
-color RayTracer::traceIndividualRay(const Ray& ray, const IScene& theScene, int recursionLevel, bool isPrimaryRay) const {
+color RayTracer::traceIndividualRay(const Ray& ray, const IScene& theScene,
+	const dvec3& cameraOrigin, int recursionLevel, bool isPrimaryRay) const {
 	const vector<VisibleIShapePtr>& opaqueObjs = theScene.opaqueObjs;
 	const vector<TransparentIShapePtr>& transparentObjs = theScene.transparentObjs;
 	const vector<LightSourcePtr>& lights = theScene.lights;
 
-	dvec3 cameraOrigin = theScene.camera->getFrame().origin;
-
 	OpaqueHitRecord opaqueHit;
 	opaqueHit.t = FLT_MAX;
 	VisibleIShape::findIntersection(ray, opaqueObjs, opaqueHit);
@@ -127,7 +204,7 @@ color RayTracer::traceIndividualRay(const Ray& ray, const IScene& theScene, int
 
 					Ray reflectionRay(reflectionStartPt, reflectionVector);
 
-					color reflectedColor = traceIndividualRay(reflectionRay, theScene, recursionLevel - 1, false);
+					color reflectedColor = traceIndividualRay(reflectionRay, theScene, cameraOrigin, recursionLevel - 1, false);
 					colorBehind += (materialSpecular * reflectedColor);
 				}
 
@@ -174,7 +251,7 @@ color RayTracer::traceIndividualRay(const Ray& ray, const IScene& theScene, int
 
 			Ray reflectionRay(reflectionStartPt, reflectionVector);
 
-			reflectedColor = traceIndividualRay(reflectionRay, theScene, recursionLevel - 1, false);
+			reflectedColor = traceIndividualRay(reflectionRay, theScene, cameraOrigin, recursionLevel - 1, false);
 		}
 		finalColor = localColor + (materialSpecular * reflectedColor);
 	}
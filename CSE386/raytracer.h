@@ -21,9 +21,17 @@
 
 struct RayTracer {
 	color defaultColor;			//!< the color to use if no intersection is present.
+	bool showAxes;				//!< true ==> overlay the world axes once tracing completes.
 	RayTracer(const color& defaultColor);
 	void raytraceScene(FrameBuffer& frameBuffer, int depth,
-		const IScene& theScene, int N) const;
+		const IScene& theScene, int N = 1, bool display = true) const;
+	void raytraceViews(FrameBuffer& frameBuffer, int depth, const IScene& theScene,
+		const vector<RaytracingCamera*>& cameras,
+		const vector<BoundingBoxi>& viewports, int N = 1) const;
 protected:
-	color traceIndividualRay(const Ray& ray, const IScene& theScene, int recursionLevel, bool isPrimaryRay) const;
+	void raytraceRows(FrameBuffer& frameBuffer, int depth, const IScene& theScene,
+		const RaytracingCamera& camera, const BoundingBoxi& viewport,
+		int N, int firstRow, int rowStep) const;
+	color traceIndividualRay(const Ray& ray, const IScene& theScene,
+		const dvec3& cameraOrigin, int recursionLevel, bool isPrimaryRay) const;
 };
\ No newline at end of file
@@ -11,6 +11,9 @@
 #include <istream>
 #include <iomanip>
 #include <cstdlib>
+#if defined(AVX2_PATHS) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 #include "defs.h"
 #include "framebuffer.h"
@@ -68,6 +71,36 @@ bool approximatelyZero(double a) {
 	return glm::abs(a) <= EPSILON;
 }
 
+/**
+ * @fn	bool cpuHasAVX2()
+ * @brief	Determines whether the AVX2 code paths can run: the CPU supports AVX2 and
+ *			the operating system saves the AVX registers. Checked once, on first call.
+ * @return	True if the AVX2 code paths can be used.
+ */
+
+bool cpuHasAVX2() {
+#if defined(AVX2_PATHS) && defined(_MSC_VER)
+	static const bool HAS_AVX2 = [] {
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) {
+			return false;
+		}
+		__cpuid(info, 1);
+		const bool OS_SAVES_AVX = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+			(_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		return OS_SAVES_AVX && (info[1] & (1 << 5)) != 0;
+	}();
+	return HAS_AVX2;
+#elif defined(AVX2_PATHS)
+	static const bool HAS_AVX2 = __builtin_cpu_supports("avx2") != 0;
+	return HAS_AVX2;
+#else
+	return false;
+#endif
+}
+
 /**
  * @fn	double normalizeDegrees(double degrees)
  * @brief	Converts an arbitrary number of degrees to an equivalent
@@ -1000,7 +1033,7 @@ string extractBaseFilename(const string& str) {
 	return str.substr(pos + 1);
 }
 
-bool DEBUG_PIXEL = false;
+thread_local bool DEBUG_PIXEL = false;
 int xDebug = -1, yDebug = -1;
 
 void mouseUtility(GLFWwindow* window, int button, int action, int modes) {
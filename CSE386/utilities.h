@@ -15,7 +15,7 @@
 #include <string>
 #include "defs.h"
 
-extern bool DEBUG_PIXEL;
+extern thread_local bool DEBUG_PIXEL;	// per thread, since pixels may be shaded in parallel
 extern int xDebug, yDebug;
 void mouseUtility(GLFWwindow* window, int button, int action, int modes);
 void keyboardUtility(GLFWwindow* window, int key, int scancode, int action, int mods);
@@ -23,6 +23,7 @@ void keyboardUtility(GLFWwindow* window, int key, int scancode, int action, int
 void swap(double& a, double& b);
 bool approximatelyEqual(double a, double b);
 bool approximatelyZero(double a);
+bool cpuHasAVX2();
 double normalizeDegrees(double degrees);
 double normalizeRadians(double rads);
 double rad2deg(double rads);
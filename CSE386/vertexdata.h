@@ -20,10 +20,14 @@ struct VertexData {
 	dvec4 pos;			//!< Processed coordinate.
 	dvec3 normal;		//!< transformed normal vector.
 	dvec3 worldPos;		//!< Saved world position, for lighting calculations.
-	Material material;	//!< This vertex's material.
+	uint16_t materialID;	//!< This vertex's material, as a MaterialPalette id.
+	dvec2 texCoord;		//!< Texture coordinates.
+	double invW;		//!< 1/w from clip coordinates; 1 before projection.
 
 	VertexData(const dvec4& pos, const dvec3& norm,
 		const Material& mat, const dvec3& worldPos);
+	VertexData(const dvec4& pos, const dvec3& norm,
+		uint16_t materialID, const dvec3& worldPos);
 	VertexData(const dvec4& pos) : VertexData(pos, dvec4(0, 0, 1, 0), bronze, ORIGIN3D) {
 	}
 	VertexData(const dvec4& pos, const dvec3& norm, const Material& mat) :
@@ -34,6 +38,7 @@ struct VertexData {
 		const dvec4& V1, const dvec4& V2, const dvec4& V3,
 		const Material& mat);
 	VertexData operator + (const VertexData& other) const;
+	const Material& getMaterial() const { return MaterialPalette::get(materialID); }
 };
 
 VertexData operator * (double w, const VertexData& V1);
@@ -7,348 +7,607 @@
  * permission is granted.
  ****************************************************/
 
+#include <atomic>
 #include "defs.h"
 #include "vertexops.h"
+#include "drawcommands.h"
+#include "workerpool.h"
+
+vector<PipelineBuffers> VertexOps::pipelineBuffers;
+vector<vector<VertexData>> VertexOps::batchResults;
+vector<VertexData> VertexOps::windowCoords;
+vector<DrawBatch> VertexOps::drawBatches;
+vector<DrawBatch> VertexOps::vertexBatches;
+vector<ModelMatrices> VertexOps::drawModels;
+vector<size_t> VertexOps::meshOffsets;
+PostTransformVertices VertexOps::meshVertices;
 
- // Planes describing the normalized device coordinates view volume - 2x2x2 cube
+/**
+ * @fn	void PipelineMatrices::refresh() const
+ * @brief	Recomputes the derived values, if the viewing or projection matrix has
+ *			changed since they were last computed. The frustum planes are read off
+ *			the rows of projection * viewing (Gribb and Hartmann) and normalized.
+ */
 
-vector<IPlane> VertexOps::allButNearNDCPlanes{ IPlane(dvec3(1, 0, 0), dvec3(-1, 0, 0)),
-												IPlane(dvec3(0, 1, 0), dvec3(0, -1, 0)),
-												IPlane(dvec3(0, 0, 1), dvec3(0, 0, -1)),
-												IPlane(dvec3(-1, 0, 0), dvec3(1, 0, 0)),
-												IPlane(dvec3(0, -1, 0), dvec3(0, 1, 0)),
-	//												IPlane(dvec3(0, 0, -1), dvec3(0, 0, 1))
-};
+void PipelineMatrices::refresh() const {
+	if (isCached && viewingMatrix == cachedViewing && projectionMatrix == cachedProjection) {
+		return;
+	}
+	cachedViewing = viewingMatrix;
+	cachedProjection = projectionMatrix;
+	isCached = true;
+
+	viewProjectionMatrix = projectionMatrix * viewingMatrix;
+	eyeFrame = Frame::createOrthoNormalBasis(viewingMatrix);
+	eyePos = eyeFrame.origin;
+
+	const dmat4& M = viewProjectionMatrix;
+	dvec4 row[4];
+	for (int i = 0; i < 4; i++) {
+		row[i] = dvec4(M[0][i], M[1][i], M[2][i], M[3][i]);
+	}
+	frustumPlanes[0] = row[3] + row[0];
+	frustumPlanes[1] = row[3] - row[0];
+	frustumPlanes[2] = row[3] + row[1];
+	frustumPlanes[3] = row[3] - row[1];
+	frustumPlanes[4] = row[3] + row[2];
+	frustumPlanes[5] = row[3] - row[2];
+	for (dvec4& plane : frustumPlanes) {
+		plane /= glm::length(dvec3(plane));
+	}
+}
 
 /**
- * @fn	vector<VertexData> triangulate(const vector<VertexData> &poly)
- * @brief	Triangulates the given polygon
- * @param	poly	The polygon to be decomposed into individual triangles.
- * @return	A vector of triangles, which comprise the original polygon.
+ * @fn	ModelMatrices::ModelMatrices(const dmat4 &modelingMatrix, const PipelineMatrices &pipeMats)
+ * @brief	Composes an object's matrices.
+ * @param	modelingMatrix	The transformation applied to the object.
+ * @param	pipeMats	  	The pipeline matrices.
  */
 
-vector<VertexData> triangulate(const vector<VertexData>& poly) {
-	vector<VertexData> triangles;
+ModelMatrices::ModelMatrices(const dmat4& modelingMatrix, const PipelineMatrices& pipeMats)
+	: modelingMatrix(modelingMatrix),
+	normalMatrix(glm::transpose(glm::inverse(dmat3(modelingMatrix)))) {
+	pipeMats.refresh();
+	modelViewProjection = pipeMats.viewProjectionMatrix * modelingMatrix;
+}
 
+/**
+ * @fn	void triangulate(const vector<VertexData> &poly, vector<VertexData> &triangles)
+ * @brief	Triangulates the given polygon
+ * @param 		  	poly	 	The polygon to be decomposed into individual triangles.
+ * @param [in,out]	triangles	The triangles, which comprise the original polygon, are
+ *								appended to this vector.
+ */
+
+void triangulate(const vector<VertexData>& poly, vector<VertexData>& triangles) {
 	for (unsigned int i = 1; i < poly.size() - 1; i++) {
 		triangles.push_back(poly[0]);
 		triangles.push_back(poly[i]);
 		triangles.push_back(poly[i + 1]);
 	}
-
-	return triangles;
 }
 
+// Clip-space planes, as (a, b, c, d) with a point inside when a*x + b*y + c*z + d*w >= 0.
+// The first six bound the view volume (-w <= x, y, z <= w). The last four are the
+// guard band: triangles reaching past the viewport but not past these are left to
+// the rasterizer, which only visits the pixels inside the window anyway.
+
+const double GUARD_BAND = 8.0;		//!< Guard band half-size, in NDC units
+const int NEAR_BIT = 4;
+const int FAR_BIT = 5;
+const int GUARD_BIT = 6;
+const dvec4 CLIP_PLANES[] = {
+	dvec4(1, 0, 0, 1), dvec4(-1, 0, 0, 1), dvec4(0, 1, 0, 1), dvec4(0, -1, 0, 1),
+	dvec4(0, 0, 1, 1), dvec4(0, 0, -1, 1),
+	dvec4(1, 0, 0, GUARD_BAND), dvec4(-1, 0, 0, GUARD_BAND),
+	dvec4(0, 1, 0, GUARD_BAND), dvec4(0, -1, 0, GUARD_BAND)
+};
+const int NUM_CLIP_PLANES = sizeof(CLIP_PLANES) / sizeof(CLIP_PLANES[0]);
+const uint32_t VIEW_VOLUME_BITS = (1u << GUARD_BIT) - 1;
+const uint32_t MUST_CLIP_BITS = (1u << NEAR_BIT) | (1u << FAR_BIT) |
+								(((1u << NUM_CLIP_PLANES) - 1) & ~VIEW_VOLUME_BITS);
+
 /**
- * @fn	vector<VertexData> VertexOps::clipAgainstPlane(vector<VertexData> &verts, const IPlane &plane)
- * @brief	Clips a polygon against a single plane
- * @param [in,out]	verts	The array of vertices.
- * @param 		  	plane	The plane that will do the clipping.
- * @return	The polygon that exludes the portions outside the given plane.
+ * @fn	void VertexOps::clipAgainstPlane(const vector<VertexData> &verts, const dvec4 &plane,
+ *										vector<VertexData> &output)
+ * @brief	Clips a polygon in homogeneous clip coordinates against a single plane.
+ * @param 		  	verts 	The array of vertices, in clip coordinates.
+ * @param 		  	plane 	The plane that will do the clipping; a vertex is kept
+ *							when dot(plane, pos) >= 0.
+ * @param [in,out]	output	Receives the polygon that exludes the portions outside the
+ *							given plane. Any previous contents are discarded.
  */
 
-vector<VertexData> VertexOps::clipAgainstPlane(vector<VertexData>& verts, const IPlane& plane) {
-	vector<VertexData> output;
-
-	if (verts.size() > 2) {
-		verts.push_back(verts[0]);
+void VertexOps::clipAgainstPlane(const vector<VertexData>& verts, const dvec4& plane,
+	vector<VertexData>& output) {
+	output.clear();
 
-		for (unsigned int i = 1; i < verts.size(); i++) {
-			bool v0In = plane.onFrontSide(verts[i - 1].pos.xyz());
-			bool v1In = plane.onFrontSide(verts[i].pos.xyz());
+	const unsigned int N = (unsigned int)verts.size();
+	if (N > 2) {
+		for (unsigned int i = 1; i <= N; i++) {
+			const VertexData& v0 = verts[i - 1];
+			const VertexData& v1 = verts[i % N];	// last edge closes the polygon
+			double d0 = glm::dot(plane, v0.pos);
+			double d1 = glm::dot(plane, v1.pos);
+			bool v0In = d0 >= 0.0;
+			bool v1In = d1 >= 0.0;
 
 			if (v0In && v1In) {
-				output.push_back(verts[i]);
+				output.push_back(v1);
 			} else if (v0In || v1In) {
-				double t;
-				plane.findIntersection(verts[i - 1].pos.xyz(), verts[i].pos.xyz(), t);
-				VertexData I(1.0 - t, verts[i - 1], t, verts[i]);
-				output.push_back(I);
+				double t = d0 / (d0 - d1);
+				output.push_back(VertexData(1.0 - t, v0, t, v1));
 				if (!v0In && v1In) {
-					output.push_back(verts[i]);
+					output.push_back(v1);
 				}
 			}
 		}
 	}
-	return output;
 }
 
 /**
- * @fn	vector<VertexData> VertexOps::clipPolygon(const vector<VertexData> &clipCoords)
- * @brief	Clip polygon against the normalized view volumn - 2x2x2 cube.
- * @param	clipCoords	The array of triangles.
- * @param	planes		Planes to clip against
- * @return	The array of triangles, after performing clipping.
+ * @fn	void VertexOps::classifyVertices(const VertexData *clipCoords, size_t numVertices,
+ *										uint32_t *outcodes, VertexData *divided)
+ * @brief	Gives each vertex an outcode, with a bit per clip plane it is outside,
+ *			and divides a copy of it by w. Different ranges of vertices can be
+ *			classified at the same time.
+ * @param 		  	clipCoords 	The vertices, in clip coordinates.
+ * @param 		  	numVertices	The number of vertices.
+ * @param [out]		outcodes   	Receives the outcode of each vertex.
+ * @param [out]		divided	   	Receives each vertex divided by w.
  */
 
-vector<VertexData> VertexOps::clipPolygon(const vector<VertexData>& clipCoords,
-	const vector<IPlane>& planes) {
-	vector<VertexData> ndcCoords;
+void VertexOps::classifyVertices(const VertexData* clipCoords, size_t numVertices,
+	uint32_t* outcodes, VertexData* divided) {
+	for (size_t i = 0; i < numVertices; i++) {
+		uint32_t code = 0;
+		for (int p = 0; p < NUM_CLIP_PLANES; p++) {
+			if (glm::dot(CLIP_PLANES[p], clipCoords[i].pos) < 0.0) {
+				code |= 1u << p;
+			}
+		}
+		outcodes[i] = code;
+		divided[i] = clipCoords[i];
+	}
+	perspectiveDivide(divided, divided + numVertices);	// only used for vertices in front of the near plane
+}
 
-	if (clipCoords.size() > 2) {
-		for (unsigned int i = 0; i < clipCoords.size() - 2; i += 3) {
-			vector<VertexData> polygon;
-			polygon.push_back(clipCoords[i]);
-			polygon.push_back(clipCoords[i + 1]);
-			polygon.push_back(clipCoords[i + 2]);
+/**
+ * @fn	void VertexOps::clipTriangles(const VertexData *clipCoords, const uint32_t *outcodes,
+ *										const VertexData *divided, const uint32_t *indices,
+ *										size_t numIndices, vector<VertexData> &ndcCoords,
+ *										PipelineBuffers &buffers)
+ * @brief	Clips triangles in homogeneous clip coordinates and passes on the
+ *			survivors divided by w. The vertices must have been classified (see
+ *			classifyVertices). Triangles outside any one side of the view volume
+ *			are dropped. Triangles inside the near and far planes and the guard
+ *			band are passed on without clipping; the rest are clipped only against
+ *			the near, far and guard band planes that they cross.
+ * @param 		  	clipCoords	The vertices, in clip coordinates.
+ * @param 		  	outcodes  	The outcode of each vertex.
+ * @param 		  	divided   	Each vertex divided by w.
+ * @param 		  	indices   	Three indices into clipCoords per triangle, or nullptr
+ *								if each triplet of clipCoords is a triangle.
+ * @param 		  	numIndices	The number of indices (or of vertices, if indices
+ *								is nullptr).
+ * @param [in,out]	ndcCoords 	Receives the clipped triangles, in normalized device
+ *								coordinates. Any previous contents are discarded.
+ * @param [in,out]	buffers   	Scratch space for polygons being clipped.
+ */
 
-			for (const IPlane& plane : planes) {
-				polygon = clipAgainstPlane(polygon, plane);
-			}
-			if (polygon.size() > 3) {
-				polygon = triangulate(polygon);
+void VertexOps::clipTriangles(const VertexData* clipCoords, const uint32_t* outcodes,
+	const VertexData* divided, const uint32_t* indices, size_t numIndices,
+	vector<VertexData>& ndcCoords,
+	PipelineBuffers& buffers) {
+	vector<VertexData>& polygon = buffers.polygon;
+	vector<VertexData>& clippedPolygon = buffers.clippedPolygon;
+	ndcCoords.clear();
+
+	for (size_t t = 0; t + 2 < numIndices; t += 3) {
+		const size_t I[3] = {
+			indices != nullptr ? indices[t] : t,
+			indices != nullptr ? indices[t + 1] : t + 1,
+			indices != nullptr ? indices[t + 2] : t + 2 };
+		uint32_t outside = outcodes[I[0]] | outcodes[I[1]] | outcodes[I[2]];
+		if ((outcodes[I[0]] & outcodes[I[1]] & outcodes[I[2]] & VIEW_VOLUME_BITS) != 0) {
+			continue;						// trivially rejected
+		}
+		uint32_t mustClip = outside & MUST_CLIP_BITS;
+		if (mustClip == 0) {				// trivially accepted
+			for (int j = 0; j < 3; j++) {
+				ndcCoords.push_back(divided[I[j]]);
 			}
-			for (const VertexData& v : polygon) {
-				ndcCoords.push_back(v);
+			continue;
+		}
+
+		polygon.clear();
+		for (int j = 0; j < 3; j++) {
+			polygon.push_back(clipCoords[I[j]]);
+		}
+		for (int p = 0; p < NUM_CLIP_PLANES; p++) {
+			if (mustClip & (1u << p)) {
+				clipAgainstPlane(polygon, CLIP_PLANES[p], clippedPolygon);
+				std::swap(polygon, clippedPolygon);		// swaps storage, not elements
 			}
 		}
+		if (polygon.size() >= 3) {
+			perspectiveDivide(polygon);
+			triangulate(polygon, ndcCoords);
+		}
 	}
-	return ndcCoords;
 }
 
 /**
- * @fn	vector<VertexData> VertexOps::clipLineSegments(const vector<VertexData> &clipCoords)
- * @brief	Clip line segments against normalized view volume.
- * @param	clipCoords	The vector of line segments that are to be clipped.
- * @param	planes	planes to clip against
- * @return	A vector&lt;VertexData&gt;
+ * @fn	void VertexOps::clipLineSegments(const vector<VertexData> &clipCoords,
+ *										vector<VertexData> &clippedCoords)
+ * @brief	Clips line segments against the view volume in homogeneous clip
+ *			coordinates, using Liang-Barsky. Each segment is parameterized as
+ *			v0 + t(v1 - v0); each of the six planes narrows the range [t0, t1]
+ *			that is inside, and the segment is dropped as soon as the range is
+ *			empty. The endpoints are then made at t0 and t1, so a segment is
+ *			interpolated at most twice however many planes it crosses. Clipping
+ *			before the divide handles segments that pass behind the eye.
+ * @param 		  	clipCoords   	The line segments, as pairs of vertices in clip
+ *									coordinates.
+ * @param [in,out]	clippedCoords	Receives the clipped segments, still in clip
+ *									coordinates. Any previous contents are discarded.
  */
 
-vector<VertexData> VertexOps::clipLineSegments(const vector<VertexData>& clipCoords,
-	const vector<IPlane>& planes) {
-	vector<VertexData> ndcCoords;
-
-	if (clipCoords.size() > 1) {
-		for (unsigned int i = 0; i < clipCoords.size() - 1; i += 2) {
-			VertexData v0 = clipCoords[i];
-			VertexData v1 = clipCoords[i + 1];
-
-			bool outsideViewVolume = false;
-
-			for (const IPlane& plane : planes) {
-				bool v0In = plane.onFrontSide(v0.pos.xyz());
-				bool v1In = plane.onFrontSide(v1.pos.xyz());
-
-				if (!v0In && !v1In) { // Line segment is entirely clipped
-					outsideViewVolume = true;
-					break;
-				} else if (v0In && !v1In) {
-					double t;
-					plane.findIntersection(v0.pos.xyz(), v1.pos.xyz(), t);
-					v1 = VertexData(1.0 - t, v0, t, v1);
-				} else if (!v0In && v1In) {
-					double t;
-					plane.findIntersection(v0.pos.xyz(), v1.pos.xyz(), t);
-					v0 = VertexData(1.0 - t, v0, t, v1);
-				} else {  // both inside
-					;
-				}
-			}
-			if (!outsideViewVolume) {
-				ndcCoords.push_back(v0);
-				ndcCoords.push_back(v1);
+void VertexOps::clipLineSegments(const vector<VertexData>& clipCoords,
+	vector<VertexData>& clippedCoords) {
+	const int NUM_VIEW_VOLUME_PLANES = 6;
+	clippedCoords.clear();
+
+	for (size_t i = 0; i + 1 < clipCoords.size(); i += 2) {
+		const VertexData& v0 = clipCoords[i];
+		const VertexData& v1 = clipCoords[i + 1];
+		double t0 = 0.0;
+		double t1 = 1.0;
+		bool outside = false;
+		for (int p = 0; p < NUM_VIEW_VOLUME_PLANES && !outside; p++) {
+			double d0 = glm::dot(CLIP_PLANES[p], v0.pos);
+			double d1 = glm::dot(CLIP_PLANES[p], v1.pos);
+			if (d0 < 0.0 && d1 < 0.0) {
+				outside = true;
+			} else if (d0 < 0.0) {
+				t0 = std::max(t0, d0 / (d0 - d1));		// entering
+			} else if (d1 < 0.0) {
+				t1 = std::min(t1, d0 / (d0 - d1));		// leaving
 			}
+			outside = outside || t0 > t1;
+		}
+		if (outside) {
+			continue;
 		}
+		clippedCoords.push_back(t0 == 0.0 ? v0 : VertexData(1.0 - t0, v0, t0, v1));
+		clippedCoords.push_back(t1 == 1.0 ? v1 : VertexData(1.0 - t1, v0, t1, v1));
 	}
-	return ndcCoords;
 }
 
 /**
-* @fn	vector<VertexData> VertexOps::processBackwardFacingTriangles(const vector<VertexData> &triangleVerts,
-*																	 bool renderBackfaces)
-* @brief	Removes the backward facing triangles
-* @param	triangleVerts	The vector of triangle vertices.
-* @param	renderBackfaces Indicates if backfaces should be rendered.
-* @return	Vector of triangle vertices, without those facing backward.
+* @fn	void VertexOps::processBackwardFacingTriangles(vector<VertexData> &triangleVerts,
+*														bool renderBackfaces)
+* @brief	Removes the backward facing triangles, in place.
+* @param [in,out]	triangleVerts	The vector of triangle vertices.
+* @param 		  	renderBackfaces Indicates if backfaces should be rendered.
 */
 
-vector<VertexData> VertexOps::processBackwardFacingTriangles(const vector<VertexData>& triangleVerts, bool renderBackfaces) {
-	vector<VertexData> triangles;
+void VertexOps::processBackwardFacingTriangles(vector<VertexData>& triangleVerts, bool renderBackfaces) {
+	size_t kept = 0;
 
 	for (int i = 0; i < (int)triangleVerts.size() - 2; i += 3) {
 		dvec3 n = normalFrom3Points(triangleVerts[i].pos.xyz(),
 			triangleVerts[i + 1].pos.xyz(),
 			triangleVerts[i + 2].pos.xyz());
-		if (n.z >= 0.0) {
-			triangles.push_back(triangleVerts[i]);
-			triangles.push_back(triangleVerts[i + 1]);
-			triangles.push_back(triangleVerts[i + 2]);
-		} else if (renderBackfaces) {
-			triangles.push_back(triangleVerts[i]);
-			triangles.back().normal *= -1;
-
-			triangles.push_back(triangleVerts[i + 1]);
-			triangles.back().normal *= -1;
-
-			triangles.push_back(triangleVerts[i + 2]);
-			triangles.back().normal *= -1;
+		if (n.z >= 0.0 || renderBackfaces) {
+			for (int j = 0; j < 3; j++) {
+				VertexData& v = triangleVerts[kept++];
+				v = triangleVerts[i + j];
+				if (n.z < 0.0) {
+					v.normal *= -1;
+				}
+			}
 		}
 	}
-	return triangles;
+	triangleVerts.erase(triangleVerts.begin() + kept, triangleVerts.end());
 }
 
 /**
- * @fn	vector<VertexData> VertexOps::transformVerticesToWorldCoordinates(const dmat4 &modelMatrix,
- *																			const vector<VertexData> &vertices)
- * @brief	Apply modeling transformation to vector of vertices. This method is called only
- *          for the first stage of the pipeline.
- * @param	modelMatrix	Modeling matrix.
- * @param	vertices   	The vector of vertices.
- * @return	The transformed vertices.
+ * @fn	void VertexOps::transformVerticesToClipCoordinates(const ModelMatrices &model,
+ *															vector<VertexData> &vertices)
+ * @brief	Takes vertices from object to clip coordinates with one composed matrix,
+ *			in place, saving their world positions and normals for lighting. This
+ *			method is called only for the first stage of the pipeline.
+ * @param 		  	model   	The object's matrices.
+ * @param [in,out]	vertices	The vector of vertices.
  */
 
-vector<VertexData> VertexOps::transformVerticesToWorldCoordinates(const dmat4& modelMatrix,
-	const vector<VertexData>& vertices) {
-	// Create 3 x 3 matrix for transforming normal vectors to world coordinates
-	dmat3 TM3x3(modelMatrix);
-	dmat3 G = glm::transpose(glm::inverse(TM3x3));
-
-	vector<VertexData> transformedVertices;
-	for (unsigned int i = 0; i < vertices.size(); i++) {
-		const VertexData& v = vertices[i];
-		dvec3 X = G * v.normal;
-		dvec3 n = glm::normalize(G * v.normal);
-		dvec4 worldPos = modelMatrix * v.pos;
-		VertexData vt(worldPos, n, v.material, worldPos.xyz());
-		transformedVertices.push_back(vt);
+void VertexOps::transformVerticesToClipCoordinates(const ModelMatrices& model,
+	vector<VertexData>& vertices) {
+	VertexData* first = vertices.data();
+	transformVerticesToClipCoordinates(model, first, first + vertices.size(), first);
+}
+
+/**
+ * @fn	void VertexOps::transformVerticesToClipCoordinates(const ModelMatrices &model,
+ *															const VertexData *first,
+ *															const VertexData *last,
+ *															VertexData *clipCoords)
+ * @brief	Takes a range of vertices from object to clip coordinates, as above,
+ *			writing them to clipCoords (which may be first itself).
+ * @param 		  	model	  	The object's matrices.
+ * @param 		  	first	  	The first vertex, in object coordinates.
+ * @param 		  	last	  	One past the last vertex.
+ * @param [out]		clipCoords	Receives the vertices in clip coordinates.
+ */
+
+void VertexOps::transformVerticesToClipCoordinates(const ModelMatrices& model,
+	const VertexData* first, const VertexData* last, VertexData* clipCoords) {
+	for (; first < last; first++, clipCoords++) {
+		VertexData v = *first;
+		v.worldPos = (model.modelingMatrix * v.pos).xyz();
+		v.pos = model.modelViewProjection * v.pos;
+		v.normal = glm::normalize(model.normalMatrix * v.normal);
+		v.invW = 1.0;
+		*clipCoords = v;
 	}
-	return transformedVertices;
 }
 
 /**
- * @fn	vector<VertexData> VertexOps::transformVertices(const dmat4 &TM,
- *														const vector<VertexData> & vertices)
- * @brief	Applies a transformation matrix to a vector of vertices. Does not change the worldPosition; copies it over.
- * @param	TM			The transformation matrix.
- * @param	vertices   	The vertices.
- * @return	The transformed vector of vertices.
+ * @fn	void VertexOps::transformVertices(const dmat4 &TM, vector<VertexData> &vertices)
+ * @brief	Applies a transformation matrix to a vector of vertices, in place. Does not
+ *			change the worldPosition.
+ * @param 		  	TM			The transformation matrix.
+ * @param [in,out]	vertices   	The vertices.
  */
 
-vector<VertexData> VertexOps::transformVertices(const dmat4& TM, const vector<VertexData>& vertices) {
-	vector<VertexData> transformedVertices;
+void VertexOps::transformVertices(const dmat4& TM, vector<VertexData>& vertices) {
+	for (VertexData& v : vertices) {
+		v.pos = TM * v.pos;
+	}
+}
 
-	for (const VertexData& v : vertices) {
-		VertexData vt(TM * v.pos, v.normal, v.material);
-		// Save the world position separately for use in per pixel lighting calculations
-		vt.worldPos = v.worldPos;
+/**
+ * @fn	void VertexOps::perspectiveDivide(vector<VertexData> &vertices)
+ * @brief	Divides clip coordinates by w, in place, keeping 1/w for
+ *			perspective-correct interpolation.
+ * @param [in,out]	vertices	The vertices, in clip coordinates.
+ */
+
+void VertexOps::perspectiveDivide(vector<VertexData>& vertices) {
+	perspectiveDivide(vertices.data(), vertices.data() + vertices.size());
+}
 
-		transformedVertices.push_back(vt);
+/**
+ * @fn	void VertexOps::perspectiveDivide(VertexData *first, VertexData *last)
+ * @brief	Divides a range of vertices by w, in place, as above.
+ * @param [in,out]	first	The first vertex, in clip coordinates.
+ * @param [in,out]	last 	One past the last vertex.
+ */
+
+void VertexOps::perspectiveDivide(VertexData* first, VertexData* last) {
+	for (; first < last; first++) {
+		VertexData& v = *first;
+		v.invW = 1.0 / std::abs(v.pos.w);
+		if (v.pos.w >= 0) {
+			v.pos /= v.pos.w;
+		} else {							// should not happen
+			v.pos.x /= -v.pos.w;
+			v.pos.y /= -v.pos.w;
+			v.pos.z = -std::abs(v.pos.z / -v.pos.w);
+			v.pos.w = 1.0;
+		}
 	}
-	return transformedVertices;
 }
 
-double computeNearPlane(const dmat4& PM) {
-	double alpha = PM[2][2];
-	double beta = PM[3][2];
-	double gamma = PM[2][3];
-	double omega = PM[3][3];
-	double nearf = -(omega + beta) / (alpha + gamma);
-	return nearf;
+/**
+ * @fn	void VertexOps::processTriangleBatch(const VertexData *first, const VertexData *last,
+ *											const ModelMatrices& model,
+ *											const PipelineMatrices& pipeMats,
+ *											bool renderBackfaces,
+ *											PipelineBuffers &buffers,
+ *											vector<VertexData> &windowCoords)
+ * @brief	Transforms a batch of triangle vertices through pipeline:
+ *					object -> world -> eye -> clip/ndc -> window.
+ *			The batch is transformed into buffers.vertices and classified there.
+ *			Batches that use different buffers can be processed at the same time.
+ * @param 		  	first			The batch's first vertex, in object coordinates.
+ * @param 		  	last			One past the batch's last vertex.
+ * @param			model			The object's matrices
+ * @param			pipeMats		Collection of matrices used in the pipeline
+ * @param			renderBackfaces	Indicates if backfaces should be rendered.
+ * @param [in,out]	buffers			Scratch buffers for this batch.
+ * @param [in,out]	windowCoords	Receives the window coordinates of the triangles
+ *									that survived culling and clipping.
+ */
+
+void VertexOps::processTriangleBatch(const VertexData* first, const VertexData* last,
+	const ModelMatrices& model,
+	const PipelineMatrices& pipeMats,
+	bool renderBackfaces,
+	PipelineBuffers& buffers,
+	vector<VertexData>& windowCoords) {
+	const dmat4& viewportMatrix = pipeMats.viewportMatrix;
+	const size_t NUM_VERTICES = last - first;
+	const VertexData UNUSED(dvec4(0, 0, 0, 1));
+	buffers.vertices.resize(NUM_VERTICES, UNUSED);
+	buffers.outcodes.resize(NUM_VERTICES);
+	buffers.projected.resize(NUM_VERTICES, UNUSED);
+
+	transformVerticesToClipCoordinates(model, first, last, buffers.vertices.data());
+	classifyVertices(buffers.vertices.data(), NUM_VERTICES, buffers.outcodes.data(),
+		buffers.projected.data());
+	clipTriangles(buffers.vertices.data(), buffers.outcodes.data(), buffers.projected.data(),
+		nullptr, NUM_VERTICES, windowCoords, buffers);
+	processBackwardFacingTriangles(windowCoords, renderBackfaces);
+	transformVertices(viewportMatrix, windowCoords);
+}
+
+/**
+ * @fn	void VertexOps::processIndexedBatch(const uint32_t *indices, size_t numIndices,
+ *											const PostTransformVertices &post, size_t offset,
+ *											const PipelineMatrices& pipeMats,
+ *											bool renderBackfaces,
+ *											PipelineBuffers &buffers,
+ *											vector<VertexData> &windowCoords)
+ * @brief	Clips, culls and maps to the window a batch of an indexed mesh's
+ *			triangles, whose vertices have already been through the vertex stage.
+ *			Batches that use different buffers can be processed at the same time.
+ * @param 		  	indices			The batch's indices, three per triangle.
+ * @param 		  	numIndices		The number of indices.
+ * @param 		  	post			The transformed vertices.
+ * @param 		  	offset			Where the mesh's vertices start in post.
+ * @param			pipeMats		Collection of matrices used in the pipeline
+ * @param			renderBackfaces	Indicates if backfaces should be rendered.
+ * @param [in,out]	buffers			Scratch buffers for this batch.
+ * @param [in,out]	windowCoords	Receives the window coordinates of the triangles
+ *									that survived culling and clipping.
+ */
+
+void VertexOps::processIndexedBatch(const uint32_t* indices, size_t numIndices,
+	const PostTransformVertices& post, size_t offset,
+	const PipelineMatrices& pipeMats,
+	bool renderBackfaces,
+	PipelineBuffers& buffers,
+	vector<VertexData>& windowCoords) {
+	clipTriangles(post.clipCoords.data() + offset, post.outcodes.data() + offset,
+		post.divided.data() + offset, indices, numIndices, windowCoords, buffers);
+	processBackwardFacingTriangles(windowCoords, renderBackfaces);
+	transformVertices(pipeMats.viewportMatrix, windowCoords);
 }
 
 /**
- * @fn	void VertexOps::processTriangleVertices(FrameBuffer &frameBuffer, const dvec3 &eyePos,
- *												const vector<LightSourcePtr> &lights,
+ * @fn	void VertexOps::processTriangleVertices(FrameBuffer &frameBuffer,
+ *												const ShadingContext &context,
  *												const vector<VertexData> &objectCoords,
  *												const dmat4& modelingMatrix,
  *												const PipelineMatrices& pipeMats,
  *												bool renderBackfaces)
- * @brief	Transforms the triangle vertices through pipeline:
- *					object -> world -> eye -> clip/ndc -> window.
+ * @brief	Transforms the triangle vertices through the pipeline and draws them.
+ *			Large meshes are split into fixed-size batches of triangles, which the
+ *			threads of the shared WorkerPool take in turn. The batches' results are
+ *			joined in their original order, so triangles are rasterized in the
+ *			order they were given.
+ *			All intermediate vertices live in VertexOps' persistent buffers, which
+ *			stop allocating once they have grown to fit the largest mesh drawn.
  * @param [in,out]	frameBuffer 	Buffer for frame data.
- * @param 		  	eyePos			The eye position.
- * @param 		  	lights			The lights.
+ * @param 		  	context			The draw's shading context.
  * @param 		  	objectCoords	The object coordinates.
  * @param			modelingMatrix	Modeling matrix
  * @param			pipeMats		Collection of matrices used in the pipeline
  * @param			renderBackfaces	Indicates if backfaces should be rendered.
  */
 
-void VertexOps::processTriangleVertices(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights,
+void VertexOps::processTriangleVertices(FrameBuffer& frameBuffer, const ShadingContext& context,
 	const vector<VertexData>& objectCoords,
 	const dmat4& modelingMatrix,
 	const PipelineMatrices& pipeMats,
 	bool renderBackfaces) {
-	const dmat4& viewingMatrix = pipeMats.viewingMatrix;
-	const dmat4& projectionMatrix = pipeMats.projectionMatrix;
-	const dmat4& viewportMatrix = pipeMats.viewportMatrix;
+	const int BATCH_TRIANGLES = 256;
+	const int NUM_TRIANGLES = (int)objectCoords.size() / 3;
+	const int NUM_BATCHES = (NUM_TRIANGLES + BATCH_TRIANGLES - 1) / BATCH_TRIANGLES;
+	const VertexData* vertices = objectCoords.data();
+	const ModelMatrices model(modelingMatrix, pipeMats);
+
+	if (NUM_BATCHES <= 1) {
+		if (pipelineBuffers.empty()) {
+			pipelineBuffers.resize(1);
+		}
+		processTriangleBatch(vertices, vertices + NUM_TRIANGLES * 3, model,
+			pipeMats, renderBackfaces, pipelineBuffers[0], windowCoords);
+		drawManyFilledTriangles(frameBuffer, context, windowCoords);
+		return;
+	}
 
-	vector<VertexData> worldCoords = transformVerticesToWorldCoordinates(modelingMatrix, objectCoords);
-	vector<VertexData> eyeCoords = transformVertices(viewingMatrix, worldCoords);
+	const int NUM_THREADS = std::min(NUM_BATCHES, WorkerPool::shared().size());
+	if ((int)pipelineBuffers.size() < NUM_THREADS) {
+		pipelineBuffers.resize(NUM_THREADS);
+	}
+	if ((int)batchResults.size() < NUM_BATCHES) {
+		batchResults.resize(NUM_BATCHES);
+	}
 
-	double nearZ = computeNearPlane(projectionMatrix);
-	vector <IPlane> nearPlane = { IPlane(dvec4(0.0, 0.0, nearZ, 1.0), -Z_AXIS) };
-	vector<VertexData> eyeCoordsClippedOnNearPlane = clipPolygon(eyeCoords, nearPlane);
+	std::atomic<int> nextBatch(0);
+	auto processBatches = [&](int t) {
+		int b;
+		while ((b = nextBatch++) < NUM_BATCHES) {
+			const VertexData* first = vertices + (size_t)b * BATCH_TRIANGLES * 3;
+			const VertexData* last = std::min(first + BATCH_TRIANGLES * 3,
+				vertices + (size_t)NUM_TRIANGLES * 3);
+			processTriangleBatch(first, last, model, pipeMats, renderBackfaces,
+				pipelineBuffers[t], batchResults[b]);
+		}
+	};
 
-	vector<VertexData> projCoords = transformVertices(projectionMatrix, eyeCoordsClippedOnNearPlane);
-	vector<VertexData> clipCoords;
+	WorkerPool::shared().run(NUM_THREADS, processBatches);
 
-	for (VertexData v : projCoords) {		// Perspective division
-		if (v.pos.w >= 0) {
-			v.pos /= v.pos.w;
-		} else {							// should not happen
-			v.pos.x /= -v.pos.w;
-			v.pos.y /= -v.pos.w;
-			v.pos.z = -std::abs(v.pos.z / -v.pos.w);
-			v.pos.w = 1.0;
-		}
-		clipCoords.push_back(v);
+	windowCoords.clear();
+	for (int b = 0; b < NUM_BATCHES; b++) {
+		windowCoords.insert(windowCoords.end(), batchResults[b].begin(), batchResults[b].end());
 	}
+	drawManyFilledTriangles(frameBuffer, context, windowCoords);
+}
 
-	clipCoords = processBackwardFacingTriangles(clipCoords, renderBackfaces);
-
-	vector<VertexData> ndcCoords = clipPolygon(clipCoords, allButNearNDCPlanes);
-	vector<VertexData> windowCoords = transformVertices(viewportMatrix, ndcCoords);
+/**
+ * @fn	void VertexOps::processIndexedTriangles(FrameBuffer &frameBuffer,
+ *												const ShadingContext &context,
+ *												const IndexedMesh &mesh,
+ *												const dmat4& modelingMatrix,
+ *												const PipelineMatrices& pipeMats,
+ *												bool renderBackfaces)
+ * @brief	Transforms an indexed mesh through the pipeline and draws it. Its
+ *			vertices and then its triangles are processed in parallel batches; see
+ *			processDraws.
+ * @param [in,out]	frameBuffer 	Buffer for frame data.
+ * @param 		  	context			The draw's shading context.
+ * @param 		  	mesh			The mesh, in object coordinates.
+ * @param			modelingMatrix	Modeling matrix
+ * @param			pipeMats		Collection of matrices used in the pipeline
+ * @param			renderBackfaces	Indicates if backfaces should be rendered.
+ */
 
-	Frame eyeFrame = Frame::createOrthoNormalBasis(viewingMatrix);
-	drawManyFilledTriangles(frameBuffer, eyePos, lights, windowCoords, eyeFrame);
+void VertexOps::processIndexedTriangles(FrameBuffer& frameBuffer, const ShadingContext& context,
+	const IndexedMesh& mesh,
+	const dmat4& modelingMatrix,
+	const PipelineMatrices& pipeMats,
+	bool renderBackfaces) {
+	const DrawCommand draw = { nullptr, &mesh, modelingMatrix, DrawState(renderBackfaces), 0.0 };
+	processDraws(&draw, 1, pipeMats);
+	drawManyFilledTriangles(frameBuffer, context, windowCoords);
 }
 
 /**
- * @fn	void VertexOps::processLineSegments(FrameBuffer &frameBuffer, const dvec3 &eyePos,
- *											const vector<LightSourcePtr> &lights,
+ * @fn	void VertexOps::processLineSegments(FrameBuffer &frameBuffer,
+ *											const ShadingContext &context,
  *											const vector<VertexData> &objectCoords,
  *											const dmat4& modelingMatrix,
  *											const PipelineMatrices& pipeMats)
- * @brief	Process the line segments through the pipeline.
+ * @brief	Process the line segments through the pipeline:
+ *					object -> clip -> clipped -> ndc -> window.
  * @param [in,out]	frameBuffer 	Frame buffer
- * @param 		  	eyePos			Eye position.
- * @param 		  	lights			The lights in the scene.
+ * @param 		  	context			The draw's shading context.
  * @param 		  	objectCoords	The vector of object coordinates.
  * @param			modelingMatrix   The modeling matrix
  * @param			pipeMats		The collection of matrices using in the pipeline
  */
 
-void VertexOps::processLineSegments(FrameBuffer& frameBuffer, const dvec3& eyePos,
-	const vector<LightSourcePtr>& lights,
+void VertexOps::processLineSegments(FrameBuffer& frameBuffer, const ShadingContext& context,
 	const vector<VertexData>& objectCoords,
 	const dmat4& modelingMatrix,
 	const PipelineMatrices& pipeMats) {
-	const dmat4& viewingMatrix = pipeMats.viewingMatrix;
-	const dmat4& projectionMatrix = pipeMats.projectionMatrix;
 	const dmat4& viewportMatrix = pipeMats.viewportMatrix;
 
-	vector<VertexData> worldCoords = transformVerticesToWorldCoordinates(modelingMatrix, objectCoords);
-
-	vector<VertexData> eyeCoords = transformVertices(viewingMatrix, worldCoords);
-	vector<VertexData> projCoords = transformVertices(projectionMatrix, eyeCoords);
-	vector<VertexData> clipCoords;
-
-	for (VertexData v : projCoords) {	// Perspective division
-		if (v.pos.w >= 0)
-			v.pos /= v.pos.w;
-		else {							// this should not happen
-			v.pos /= -v.pos.w;
-			v.pos.z = -std::abs(v.pos.z);
-		}
-		clipCoords.push_back(v);
+	if (pipelineBuffers.empty()) {
+		pipelineBuffers.resize(1);
 	}
-
-	vector<VertexData> ndcCoords = clipLineSegments(clipCoords, allButNearNDCPlanes);
-	vector<VertexData> windowCoords = transformVertices(viewportMatrix, ndcCoords);
-	Frame eyeFrame = Frame::createOrthoNormalBasis(viewingMatrix);
-	drawManyLines(frameBuffer, eyePos, lights, windowCoords, eyeFrame);
+	vector<VertexData>& verts = pipelineBuffers[0].vertices;
+	verts.assign(objectCoords.begin(), objectCoords.end());
+
+	transformVerticesToClipCoordinates(ModelMatrices(modelingMatrix, pipeMats), verts);
+	clipLineSegments(verts, windowCoords);
+	perspectiveDivide(windowCoords);
+	transformVertices(viewportMatrix, windowCoords);
+	drawManyLines(frameBuffer, context, windowCoords);
 }
 
 /**
@@ -368,13 +627,231 @@ void VertexOps::render(FrameBuffer& frameBuffer, const vector<VertexData>& verts
 	const dmat4& modelingMatrix,
 	const PipelineMatrices& pipeMats,
 	bool renderBackfaces) {
-	const dmat4& viewingMatrix = pipeMats.viewingMatrix;
+	pipeMats.refresh();
+	ShadingContext context(pipeMats.eyePos, pipeMats.eyeFrame, lights);
+	VertexOps::processTriangleVertices(frameBuffer, context, verts,
+		modelingMatrix, pipeMats, renderBackfaces);
+}
 
-	dvec3 eyePos = glm::inverse(viewingMatrix)[3].xyz();
-	VertexOps::processTriangleVertices(frameBuffer, eyePos, lights, verts,
+/**
+ * @fn	bool VertexOps::isOutsideFrustum(const BoundingSphere &bounds,
+ *										const dmat4 &modelingMatrix,
+ *										const PipelineMatrices &pipeMats)
+ * @brief	Tests an object's bounding sphere against the view frustum, using the
+ *			world-space planes cached in pipeMats. Spheres that only touch or overlap
+ *			the frustum are not outside.
+ * @param	bounds		  	The object's bounding sphere, in object coordinates.
+ * @param	modelingMatrix	The transformation applied to the object.
+ * @param	pipeMats	  	The pipeline matrices.
+ * @return	True if the whole sphere is outside the frustum; false if it may be
+ *			visible or its bound is unknown.
+ */
+
+bool VertexOps::isOutsideFrustum(const BoundingSphere& bounds,
+	const dmat4& modelingMatrix,
+	const PipelineMatrices& pipeMats) {
+	if (bounds.radius < 0.0) {
+		return false;
+	}
+	dvec3 center = (modelingMatrix * dvec4(bounds.center, 1.0)).xyz();
+	double scale = std::max(glm::length(dvec3(modelingMatrix[0])),
+		std::max(glm::length(dvec3(modelingMatrix[1])), glm::length(dvec3(modelingMatrix[2]))));
+	double radius = bounds.radius * scale;
+
+	pipeMats.refresh();
+	for (const dvec4& plane : pipeMats.frustumPlanes) {
+		if (glm::dot(dvec3(plane), center) + plane.w < -radius) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @fn	void VertexOps::render(FrameBuffer &frameBuffer, const EShapeData &shape,
+ *								const vector<LightSourcePtr> &lights,
+ *								const dmat4 &modelingMatrix,
+ *								const PipelineMatrices &pipeMats, bool renderBackfaces)
+ * @brief	Renders a shape, unless its bounding sphere is out of view.
+ * @param [in,out]	frameBuffer	Buffer for frame data.
+ * @param 		  	shape	   	The shape.
+ * @param 		  	lights	   	The lights.
+ * @param           modelingMatrix  The transformation applied to the object
+ * @param 		  	pipeMats    The pipeline matrices
+ * @param           renderBackfaces True if backfaces are to be rendered
+ */
+
+void VertexOps::render(FrameBuffer& frameBuffer, const EShapeData& shape,
+	const vector<LightSourcePtr>& lights,
+	const dmat4& modelingMatrix,
+	const PipelineMatrices& pipeMats,
+	bool renderBackfaces) {
+	if (isOutsideFrustum(shape.bounds, modelingMatrix, pipeMats)) {
+		return;
+	}
+	const vector<VertexData>& verts = shape;
+	render(frameBuffer, verts, lights, modelingMatrix, pipeMats, renderBackfaces);
+}
+
+/**
+ * @fn	void VertexOps::render(FrameBuffer &frameBuffer, const IndexedMesh &mesh,
+ *								const vector<LightSourcePtr> &lights,
+ *								const dmat4 &modelingMatrix,
+ *								const PipelineMatrices &pipeMats, bool renderBackfaces)
+ * @brief	Renders an indexed mesh, unless its bounding sphere is out of view.
+ * @param [in,out]	frameBuffer	Buffer for frame data.
+ * @param 		  	mesh	   	The mesh.
+ * @param 		  	lights	   	The lights.
+ * @param           modelingMatrix  The transformation applied to the object
+ * @param 		  	pipeMats    The pipeline matrices
+ * @param           renderBackfaces True if backfaces are to be rendered
+ */
+
+void VertexOps::render(FrameBuffer& frameBuffer, const IndexedMesh& mesh,
+	const vector<LightSourcePtr>& lights,
+	const dmat4& modelingMatrix,
+	const PipelineMatrices& pipeMats,
+	bool renderBackfaces) {
+	if (isOutsideFrustum(mesh.bounds, modelingMatrix, pipeMats)) {
+		return;
+	}
+	pipeMats.refresh();
+	ShadingContext context(pipeMats.eyePos, pipeMats.eyeFrame, lights);
+	VertexOps::processIndexedTriangles(frameBuffer, context, mesh,
 		modelingMatrix, pipeMats, renderBackfaces);
 }
 
+/**
+ * @fn	void VertexOps::render(FrameBuffer &frameBuffer, const vector<DrawCommand> &commands,
+ *								const vector<LightSourcePtr> &lights,
+ *								const PipelineMatrices &pipeMats)
+ * @brief	Renders many draws as one. The draws are processed together (see
+ *			processDraws) and rasterized together, so the shading context, the
+ *			threads and the rasterizer's binning are set up once for all of them.
+ *			Culling and sorting are up to the caller; see DrawCommandBuffer.
+ * @param [in,out]	frameBuffer	Buffer for frame data.
+ * @param 		  	commands   	The draws, in the order they are to be drawn.
+ * @param 		  	lights	   	The lights.
+ * @param 		  	pipeMats   	The pipeline matrices.
+ */
+
+void VertexOps::render(FrameBuffer& frameBuffer, const vector<DrawCommand>& commands,
+	const vector<LightSourcePtr>& lights,
+	const PipelineMatrices& pipeMats) {
+	if (commands.empty()) {
+		return;
+	}
+	processDraws(commands.data(), (int)commands.size(), pipeMats);
+	ShadingContext context(pipeMats.eyePos, pipeMats.eyeFrame, lights);
+	drawManyFilledTriangles(frameBuffer, context, windowCoords);
+}
+
+/**
+ * @fn	void VertexOps::processDraws(const DrawCommand *commands, int numCommands,
+ *									const PipelineMatrices &pipeMats)
+ * @brief	Takes draws through the vertex stages, into windowCoords. The work is
+ *			split into batches that the WorkerPool's threads take from shared
+ *			queues, in two passes. First the distinct vertices of every indexed
+ *			mesh are transformed and classified, in ranges, into meshVertices.
+ *			Then the triangles of every draw, shapes and indexed meshes alike, are
+ *			clipped, culled and mapped to the window in fixed-size batches. The
+ *			batches' results are joined in the order of the draws and of their
+ *			triangles. Each draw's matrices are composed once for all its batches.
+ * @param 		  	commands   	The draws.
+ * @param 		  	numCommands	The number of draws.
+ * @param 		  	pipeMats   	The pipeline matrices.
+ */
+
+void VertexOps::processDraws(const DrawCommand* commands, int numCommands,
+	const PipelineMatrices& pipeMats) {
+	const int BATCH_TRIANGLES = 256;
+	const int BATCH_VERTICES = 1024;
+	pipeMats.refresh();
+
+	drawModels.clear();
+	meshOffsets.clear();
+	vertexBatches.clear();
+	drawBatches.clear();
+	size_t numMeshVertices = 0;
+	for (int c = 0; c < numCommands; c++) {
+		const DrawCommand& cmd = commands[c];
+		drawModels.push_back(ModelMatrices(cmd.modelingMatrix, pipeMats));
+		meshOffsets.push_back(numMeshVertices);
+		int numTriangles;
+		if (cmd.mesh != nullptr) {
+			const int NUM_VERTICES = (int)cmd.mesh->vertices.size();
+			for (int v = 0; v < NUM_VERTICES; v += BATCH_VERTICES) {
+				vertexBatches.push_back(DrawBatch{ c, v, std::min(v + BATCH_VERTICES, NUM_VERTICES) });
+			}
+			numMeshVertices += NUM_VERTICES;
+			numTriangles = (int)cmd.mesh->numTriangles();
+		} else {
+			numTriangles = (int)cmd.shape->size() / 3;
+		}
+		for (int t = 0; t < numTriangles; t += BATCH_TRIANGLES) {
+			drawBatches.push_back(DrawBatch{ c, t, std::min(t + BATCH_TRIANGLES, numTriangles) });
+		}
+	}
+	meshVertices.resize(numMeshVertices);
+
+	const int NUM_VERTEX_BATCHES = (int)vertexBatches.size();
+	const int NUM_BATCHES = (int)drawBatches.size();
+	const int NUM_THREADS = std::min(std::max(NUM_BATCHES, NUM_VERTEX_BATCHES),
+		WorkerPool::shared().size());
+	if ((int)pipelineBuffers.size() < NUM_THREADS) {
+		pipelineBuffers.resize(NUM_THREADS);
+	}
+	if ((int)batchResults.size() < NUM_BATCHES) {
+		batchResults.resize(NUM_BATCHES);
+	}
+
+	std::atomic<int> nextBatch(0);
+	auto processVertexBatches = [&](int) {
+		int b;
+		while ((b = nextBatch++) < NUM_VERTEX_BATCHES) {
+			const DrawBatch& batch = vertexBatches[b];
+			const VertexData* vertices = commands[batch.command].mesh->vertices.data();
+			const size_t first = meshOffsets[batch.command] + batch.first;
+			transformVerticesToClipCoordinates(drawModels[batch.command],
+				vertices + batch.first, vertices + batch.last, &meshVertices.clipCoords[first]);
+			classifyVertices(&meshVertices.clipCoords[first], batch.last - batch.first,
+				&meshVertices.outcodes[first], &meshVertices.divided[first]);
+		}
+	};
+	WorkerPool::shared().run(std::min(NUM_VERTEX_BATCHES, NUM_THREADS), processVertexBatches);
+
+	nextBatch = 0;
+	auto processBatches = [&](int t) {
+		int b;
+		while ((b = nextBatch++) < NUM_BATCHES) {
+			const DrawBatch& batch = drawBatches[b];
+			const DrawCommand& cmd = commands[batch.command];
+			vector<VertexData>& result = batchResults[b];
+			if (cmd.mesh != nullptr) {
+				processIndexedBatch(cmd.mesh->indices.data() + 3 * (size_t)batch.first,
+					3 * (size_t)(batch.last - batch.first), meshVertices, meshOffsets[batch.command],
+					pipeMats, cmd.state.renderBackfaces, pipelineBuffers[t], result);
+			} else {
+				const VertexData* vertices = cmd.shape->data();
+				processTriangleBatch(vertices + 3 * batch.first, vertices + 3 * batch.last,
+					drawModels[batch.command], pipeMats,
+					cmd.state.renderBackfaces, pipelineBuffers[t], result);
+			}
+			if (cmd.state.materialID != DrawState::KEEP_MATERIAL) {
+				for (VertexData& v : result) {
+					v.materialID = (uint16_t)cmd.state.materialID;
+				}
+			}
+		}
+	};
+	WorkerPool::shared().run(NUM_THREADS, processBatches);
+
+	windowCoords.clear();
+	for (int b = 0; b < NUM_BATCHES; b++) {
+		windowCoords.insert(windowCoords.end(), batchResults[b].begin(), batchResults[b].end());
+	}
+}
+
 /**
  * @fn	void VertexOps::getViewportTransformation()
  * @brief	Sets viewport transformation based on the current viewport settings.
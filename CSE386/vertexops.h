@@ -16,34 +16,119 @@
 #include "iscene.h"
 #include "rasterization.h"
 
+struct DrawCommand;
+
  /**
   * @class	PipelineMatrices
   * @brief	Class to encapsulate the final three matrices used in the graphics pipeline.
+  *			The values derived from them are cached: refresh recomputes them only
+  *			when the viewing or projection matrix has changed since the last call.
+  *			The pipeline calls refresh on the rendering thread before any worker
+  *			threads start, so the workers only ever read the cached values.
   */
 
 struct PipelineMatrices {
 	dmat4 viewingMatrix;
 	dmat4 projectionMatrix;
 	dmat4 viewportMatrix;
+
+	mutable dmat4 viewProjectionMatrix;	//!< projectionMatrix * viewingMatrix
+	mutable dvec3 eyePos;				//!< Eye position in world coordinates
+	mutable Frame eyeFrame;				//!< The camera's frame
+	mutable dvec4 frustumPlanes[6];		//!< World planes (a, b, c, d), unit normals pointing in; near is [4]
+
+	PipelineMatrices() : isCached(false) {}
+	void refresh() const;
+protected:
+	mutable dmat4 cachedViewing;		//!< viewingMatrix the derived values were computed from
+	mutable dmat4 cachedProjection;		//!< projectionMatrix the derived values were computed from
+	mutable bool isCached;				//!< False until the first refresh
+};
+
+/**
+ * @struct	ModelMatrices
+ * @brief	The matrices that take one object through the pipeline, composed once
+ *			per draw rather than once per batch or per vertex.
+ */
+
+struct ModelMatrices {
+	dmat4 modelingMatrix;		//!< Object to world coordinates
+	dmat3 normalMatrix;			//!< Object to world coordinates, for normals
+	dmat4 modelViewProjection;	//!< Object to clip coordinates
+
+	ModelMatrices(const dmat4& modelingMatrix, const PipelineMatrices& pipeMats);
+};
+
+/**
+ * @struct	PipelineBuffers
+ * @brief	Scratch buffers for one thread's pass through the vertex stages. They
+ *			keep their capacity from draw to draw, so once they have grown to fit
+ *			the largest batch, processing a batch does not allocate.
+ */
+
+struct PipelineBuffers {
+	vector<VertexData> vertices;		//!< The batch, transformed in place stage by stage
+	vector<VertexData> polygon;			//!< Polygon being clipped
+	vector<VertexData> clippedPolygon;	//!< Polygon clipped against one more plane
+	vector<uint32_t> outcodes;			//!< Per vertex, a bit for each clip plane it is outside
+	vector<VertexData> projected;		//!< Each vertex divided by w
+};
+
+/**
+ * @struct	PostTransformVertices
+ * @brief	The distinct vertices of indexed meshes after the vertex stage, which
+ *			the meshes' indices then refer to. Each vertex is transformed, given an
+ *			outcode and divided by w exactly once.
+ */
+
+struct PostTransformVertices {
+	vector<VertexData> clipCoords;	//!< Clip coordinates
+	vector<uint32_t> outcodes;		//!< Per vertex, a bit for each clip plane it is outside
+	vector<VertexData> divided;		//!< Each vertex divided by w
+
+	void resize(size_t numVertices) {
+		const VertexData UNUSED(dvec4(0, 0, 0, 1));
+		clipCoords.resize(numVertices, UNUSED);
+		outcodes.resize(numVertices);
+		divided.resize(numVertices, UNUSED);
+	}
+};
+
+/**
+ * @struct	DrawBatch
+ * @brief	A range of one draw's work, as queued by VertexOps: triangles [first,
+ *			last) of a shape or of an indexed mesh, or, in the vertex stage,
+ *			vertices [first, last) of an indexed mesh.
+ */
+
+struct DrawBatch {
+	int command;		//!< Index of the draw
+	int first;			//!< First triangle or vertex of the batch
+	int last;			//!< One past the last triangle or vertex of the batch
 };
 
 /**
  * @class	VertexOps
  * @brief	Class to encapsulate the methods related to vertex processing for Pipeline graphics.
+ *			The intermediate vertices of every draw live in static buffers that are
+ *			reused from draw to draw, so steady-state frames do not allocate. As a
+ *			result, the render and process functions are not reentrant: only one
+ *			thread at a time may draw.
  */
 
 class VertexOps {
 public:
-	static vector<IPlane> allButNearNDCPlanes;		//!< 5 of the 6 planes of the 2x2x2 cube.
-
-	static void processTriangleVertices(FrameBuffer& frameBuffer, const dvec3& eyePos,
-		const vector<LightSourcePtr>& lights,
+	static void processTriangleVertices(FrameBuffer& frameBuffer, const ShadingContext& context,
 		const vector<VertexData>& objectCoords,
 		const dmat4& modelingMatrix,
 		const PipelineMatrices& pipeMats,
 		bool renderBackfaces);
-	static void processLineSegments(FrameBuffer& frameBuffer, const dvec3& eyePos,
-		const vector<LightSourcePtr>& lights,
+	static void processIndexedTriangles(FrameBuffer& frameBuffer, const ShadingContext& context,
+		const IndexedMesh& mesh,
+		const dmat4& modelingMatrix,
+		const PipelineMatrices& pipeMats,
+		bool renderBackfaces);
+	static void processLineSegments(FrameBuffer& frameBuffer, const ShadingContext& context,
 		const vector<VertexData>& objectCoords,
 		const dmat4& modelingMatrix,
 		const PipelineMatrices& pipeMats);
@@ -53,16 +138,65 @@ public:
 		const PipelineMatrices& pipeMats,
 		bool renderBackfaces
 	);
+	static void render(FrameBuffer& frameBuffer, const EShapeData& shape,
+		const vector<LightSourcePtr>& lights,
+		const dmat4& modelingMatrix,
+		const PipelineMatrices& pipeMats,
+		bool renderBackfaces);
+	static void render(FrameBuffer& frameBuffer, const IndexedMesh& mesh,
+		const vector<LightSourcePtr>& lights,
+		const dmat4& modelingMatrix,
+		const PipelineMatrices& pipeMats,
+		bool renderBackfaces);
+	static void render(FrameBuffer& frameBuffer, const vector<DrawCommand>& commands,
+		const vector<LightSourcePtr>& lights,
+		const PipelineMatrices& pipeMats);
+	static bool isOutsideFrustum(const BoundingSphere& bounds,
+		const dmat4& modelingMatrix,
+		const PipelineMatrices& pipeMats);
 	static dmat4 getViewportTransformation(int left, int width, int bottom, int height);
 protected:
-	static vector<VertexData> clipAgainstPlane(vector<VertexData>& verts, const IPlane& plane);
-	static vector<VertexData> clipPolygon(const vector<VertexData>& clipCoords,
-		const vector<IPlane>& planes);
-	static vector<VertexData> clipLineSegments(const vector<VertexData>& clipCoords,
-		const vector<IPlane>& planes);
-	static vector<VertexData> processBackwardFacingTriangles(const vector<VertexData>& triangleVerts,
+	static vector<PipelineBuffers> pipelineBuffers;		//!< One set per vertex-processing thread
+	static vector<vector<VertexData>> batchResults;	//!< Window coordinates from each batch
+	static vector<VertexData> windowCoords;			//!< What is handed to the rasterizer
+	static vector<DrawBatch> drawBatches;			//!< Triangle batches of the draws being processed
+	static vector<DrawBatch> vertexBatches;			//!< Vertex batches of the indexed meshes being processed
+	static vector<ModelMatrices> drawModels;		//!< Each draw's matrices
+	static vector<size_t> meshOffsets;				//!< Where each draw's vertices start in meshVertices
+	static PostTransformVertices meshVertices;		//!< The indexed meshes' transformed vertices
+
+	static void processDraws(const DrawCommand* commands, int numCommands,
+		const PipelineMatrices& pipeMats);
+
+	static void processTriangleBatch(const VertexData* first, const VertexData* last,
+		const ModelMatrices& model,
+		const PipelineMatrices& pipeMats,
+		bool renderBackfaces,
+		PipelineBuffers& buffers,
+		vector<VertexData>& windowCoords);
+	static void processIndexedBatch(const uint32_t* indices, size_t numIndices,
+		const PostTransformVertices& post, size_t offset,
+		const PipelineMatrices& pipeMats,
+		bool renderBackfaces,
+		PipelineBuffers& buffers,
+		vector<VertexData>& windowCoords);
+	static void clipAgainstPlane(const vector<VertexData>& verts, const dvec4& plane,
+		vector<VertexData>& output);
+	static void classifyVertices(const VertexData* clipCoords, size_t numVertices,
+		uint32_t* outcodes, VertexData* divided);
+	static void clipTriangles(const VertexData* clipCoords, const uint32_t* outcodes,
+		const VertexData* divided, const uint32_t* indices, size_t numIndices,
+		vector<VertexData>& ndcCoords,
+		PipelineBuffers& buffers);
+	static void clipLineSegments(const vector<VertexData>& clipCoords,
+		vector<VertexData>& clippedCoords);
+	static void processBackwardFacingTriangles(vector<VertexData>& triangleVerts,
 		bool renderBackfaces);
-	static vector<VertexData> transformVerticesToWorldCoordinates(const dmat4& modelMatrix,
-		const vector<VertexData>& vertices);
-	static vector<VertexData> transformVertices(const dmat4& TM, const vector<VertexData>& vertices);
+	static void transformVerticesToClipCoordinates(const ModelMatrices& model,
+		vector<VertexData>& vertices);
+	static void transformVerticesToClipCoordinates(const ModelMatrices& model,
+		const VertexData* first, const VertexData* last, VertexData* clipCoords);
+	static void transformVertices(const dmat4& TM, vector<VertexData>& vertices);
+	static void perspectiveDivide(vector<VertexData>& vertices);
+	static void perspectiveDivide(VertexData* first, VertexData* last);
 };
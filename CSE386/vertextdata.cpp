@@ -25,12 +25,34 @@ VertexData::VertexData(const dvec4& P,
 	const dvec3& norm,
 	const Material& mat,
 	const dvec3& WP) :
-	pos(P), normal(glm::normalize(norm)), material(mat), worldPos(WP) {
+	VertexData(P, norm, MaterialPalette::idOf(mat), WP) {
+}
+
+/**
+ * @fn	VertexData::VertexData(const dvec4 &P, const dvec3 &norm,
+ *								uint16_t materialID, const dvec3 &WP)
+ * @brief	Constructor for a material that is already in the palette.
+ * @param	P			Current coordinate.
+ * @param	norm		Normal vector
+ * @param	materialID	MaterialPalette id of the material.
+ * @param	WP			World position.
+ */
+
+VertexData::VertexData(const dvec4& P,
+	const dvec3& norm,
+	uint16_t materialID,
+	const dvec3& WP) :
+	pos(P), normal(glm::normalize(norm)), worldPos(WP), materialID(materialID),
+	texCoord(0.0, 0.0), invW(1.0) {
 }
 
 /**
  * @fn	VertexData::VertexData(double w1, const VertexData &vd1, double w2, const VertexData &vd2)
- * @brief	Constructs object using weighted average of two VertexData objects.
+ * @brief	Constructs object using weighted average of two VertexData objects. The
+ *			weights apply to pos and invW, which are linear where clipping happens.
+ *			The other attributes are weighted perspective-correctly, by w1 / w and
+ *			w2 / w; before projection, invW is 1 and this is the same thing. Material
+ *			ids cannot be averaged, so the vertex with the larger weight supplies it.
  * @param	w1 	Weight #1.
  * @param	vd1	VertexData #1.
  * @param	w2 	Weight #2.
@@ -40,9 +62,13 @@ VertexData::VertexData(const dvec4& P,
 VertexData::VertexData(double w1, const VertexData& vd1,
 	double w2, const VertexData& vd2)
 	: pos(weightedAverage(w1, vd1.pos, w2, vd2.pos)),
-	normal(weightedAverage(w1, vd1.normal, w2, vd2.normal)),
-	material(weightedAverage(w1, vd1.material, w2, vd2.material)),
-	worldPos(weightedAverage(w1, vd1.worldPos, w2, vd2.worldPos)) {
+	materialID(w1 >= w2 ? vd1.materialID : vd2.materialID),
+	invW(w1 * vd1.invW + w2 * vd2.invW) {
+	double p1 = w1 * vd1.invW / invW;
+	double p2 = w2 * vd2.invW / invW;
+	normal = weightedAverage(p1, vd1.normal, p2, vd2.normal);
+	worldPos = weightedAverage(p1, vd1.worldPos, p2, vd2.worldPos);
+	texCoord = weightedAverage(p1, vd1.texCoord, p2, vd2.texCoord);
 }
 
 /**
@@ -75,11 +101,13 @@ void VertexData::addTriVertsAndComputeNormal(vector<VertexData>& verts,
  * @brief	Multiplication operator for VertexData objects
  * @param	w   	The scalar multiplier.
  * @param	data	Vertex data to scale.
- * @return	The scaled Vertex data.
+ * @return	The scaled Vertex data. The material is unchanged.
  */
 
 VertexData operator * (double w, const VertexData& data) {
-	VertexData result(w * data.pos, w * data.normal, w * data.material, w * data.worldPos);
+	VertexData result(w * data.pos, w * data.normal, data.materialID, w * data.worldPos);
+	result.texCoord = w * data.texCoord;
+	result.invW = w * data.invW;
 	return result;
 }
 
@@ -87,14 +115,15 @@ VertexData operator * (double w, const VertexData& data) {
  * @fn	VertexData VertexData::operator+ (const VertexData &other) const
  * @brief	Addition operator for VertexData objects
  * @param	other	The 2nd VertexData object.
- * @return	The raw summation of the two VertexData objects
+ * @return	The raw summation of the two VertexData objects. The material is this one's.
  */
 
 VertexData VertexData::operator + (const VertexData& other) const {
 	VertexData result(*this);
-	result.material += other.material;
 	result.normal += other.normal;
 	result.pos += other.pos;
 	result.worldPos += other.worldPos;
+	result.texCoord += other.texCoord;
+	result.invW += other.invW;
 	return result;
 }
@@ -0,0 +1,121 @@
+/****************************************************
+ * 2016-2025 Eric Bachmann and Mike Zmuda
+ * All Rights Reserved.
+ * NOTICE:
+ * Dissemination of this information or reproduction
+ * of this material is prohibited unless prior written
+ * permission is granted.
+ ****************************************************/
+
+#include "workerpool.h"
+
+/**
+ * @fn	WorkerPool &WorkerPool::shared()
+ * @brief	The pool used by the renderer. It is created on first use, with one
+ *			thread per hardware thread (counting the caller's).
+ * @return	The shared pool.
+ */
+
+WorkerPool& WorkerPool::shared() {
+	static WorkerPool pool(std::max(1, (int)std::thread::hardware_concurrency()));
+	return pool;
+}
+
+/**
+ * @fn	WorkerPool::WorkerPool(int numThreads)
+ * @brief	Starts numThreads - 1 workers; the thread calling run is the other one.
+ * @param	numThreads	Number of threads that run tasks.
+ */
+
+WorkerPool::WorkerPool(int numThreads)
+	: caller(nullptr), task(nullptr), numTasks(0), nextTask(0),
+	busyWorkers(0), generation(0), quitting(false) {
+	for (int i = 1; i < numThreads; i++) {
+		workers.push_back(std::thread(&WorkerPool::workerLoop, this));
+	}
+}
+
+/**
+ * @fn	WorkerPool::~WorkerPool()
+ * @brief	Destructor. Stops the workers.
+ */
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		quitting = true;
+	}
+	workReady.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+/**
+ * @fn	void WorkerPool::runTasks(int numTasks, TaskCaller caller, const void *task)
+ * @brief	Runs caller(task, t) for t in [0, numTasks) and waits for all of them.
+ * @param	numTasks	Number of tasks.
+ * @param	caller  	Calls the task.
+ * @param	task		The task.
+ */
+
+void WorkerPool::runTasks(int numTasks, TaskCaller caller, const void* task) {
+	std::unique_lock<std::mutex> running(runMutex, std::try_to_lock);
+	if (!running.owns_lock() || workers.empty() || numTasks <= 1) {
+		for (int t = 0; t < numTasks; t++) {
+			caller(task, t);
+		}
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mtx);
+	this->caller = caller;
+	this->task = task;
+	this->numTasks = numTasks;
+	nextTask = 0;
+	busyWorkers = (int)workers.size();
+	generation++;
+	lock.unlock();
+	workReady.notify_all();
+
+	doTasks();
+
+	lock.lock();
+	workDone.wait(lock, [this] { return busyWorkers == 0; });
+}
+
+/**
+ * @fn	void WorkerPool::doTasks()
+ * @brief	Claims and runs tasks of the current run until none are left.
+ */
+
+void WorkerPool::doTasks() {
+	for (int t = nextTask++; t < numTasks; t = nextTask++) {
+		caller(task, t);
+	}
+}
+
+/**
+ * @fn	void WorkerPool::workerLoop()
+ * @brief	Body of each worker thread: waits for a run, helps with it, repeats.
+ */
+
+void WorkerPool::workerLoop() {
+	unsigned int lastGeneration = 0;
+	while (true) {
+		std::unique_lock<std::mutex> lock(mtx);
+		workReady.wait(lock, [&] { return quitting || generation != lastGeneration; });
+		if (quitting) {
+			return;
+		}
+		lastGeneration = generation;
+		lock.unlock();
+
+		doTasks();
+
+		lock.lock();
+		if (--busyWorkers == 0) {
+			workDone.notify_one();
+		}
+	}
+}
@@ -0,0 +1,63 @@
+/****************************************************
+ * 2016-2025 Eric Bachmann and Mike Zmuda
+ * All Rights Reserved.
+ * NOTICE:
+ * Dissemination of this information or reproduction
+ * of this material is prohibited unless prior written
+ * permission is granted.
+ ****************************************************/
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "defs.h"
+
+/**
+ * @class	WorkerPool
+ * @brief	A fixed set of worker threads, started once and shared by every parallel
+ *			stage (vertex batches, tile rasterization, the G-buffer pass, ray tracing
+ *			and OBJ parsing), so that no stage pays for creating threads.
+ *
+ *			run(numTasks, task) calls task(t) once for each t in [0, numTasks), on
+ *			the calling thread and the workers, and returns when all the calls have
+ *			finished. Distinct tasks may run at the same time, but a given t runs on
+ *			one thread only, so t can index per-thread scratch storage. Nothing is
+ *			allocated per run. If the pool is already busy (e.g., run is called from
+ *			inside a task or from a second thread), the tasks simply run one after
+ *			another on the calling thread.
+ */
+
+class WorkerPool {
+public:
+	static WorkerPool& shared();
+	~WorkerPool();
+	int size() const { return (int)workers.size() + 1; }
+
+	template <class TASK>
+	void run(int numTasks, const TASK& task) {
+		runTasks(numTasks, [](const void* f, int t) { (*(const TASK*)f)(t); }, &task);
+	}
+protected:
+	typedef void (*TaskCaller)(const void* task, int t);
+
+	explicit WorkerPool(int numThreads);
+	void runTasks(int numTasks, TaskCaller caller, const void* task);
+	void doTasks();
+	void workerLoop();
+
+	vector<std::thread> workers;		//!< The threads, other than the caller's
+	std::mutex runMutex;				//!< Held for the whole of a run
+	std::mutex mtx;						//!< Guards the fields below
+	std::condition_variable workReady;	//!< Signaled when a run starts, or the pool stops
+	std::condition_variable workDone;	//!< Signaled when the last worker finishes a run
+	TaskCaller caller;					//!< Calls the current run's task
+	const void* task;					//!< The current run's task
+	int numTasks;						//!< Number of tasks in the current run
+	std::atomic<int> nextTask;			//!< Next task to be claimed
+	int busyWorkers;					//!< Workers still in the current run
+	unsigned int generation;			//!< Incremented for each run
+	bool quitting;						//!< True once the pool is being destroyed
+};